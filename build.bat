@@ -1,4 +1,7 @@
 @echo off
 IF NOT EXIST build (mkdir build)
 clang -g code/main.c -I include -I include/SDL3 lib/Windows/x64/SDL3.lib -o build/game.exe
+clang -O2 code/bake.c -I include -o build/bake.exe
+build\bake.exe build\assets.pack res\background_lights1.png res\background_lights_red.png res\background_nolight1.png res\cat_animation_body.png res\cat_animation_face.png res\cat_animation_tail.png res\cat_boss_loose1.png res\cat_boss_neutral.png res\conveyorbelt_circle1.png res\conveyorbelt_dot1.png res\conveyorbelt_frontwheel1.png res\conveyorbelt_interior.png res\conveyorbelt_static1.png res\item_bear.png res\item_computer.png res\item_duck.png res\item_flower.png res\item_lamp.png res\item_mirror.png res\item_plant.png res\item_statue.png res\item_toster.png res\item_vase.png
+REM embedded pack: clang -g -DEMBEDDED_ASSETS code/main.c code/embedded_pack.S -I include -I include/SDL3 lib/Windows/x64/SDL3.lib -o build/game_embedded.exe
 REM clang -g ../code/main.c -Wl,/SUBSYSTEM:WINDOWS -I ../include -I ../include/SDL3 ../lib/Windows/x64/SDL3.lib -o game.exe
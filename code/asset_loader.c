@@ -0,0 +1,668 @@
+// Asynchronous texture loader.
+//
+// Files are read through an SDL_AsyncIOQueue, decoded and trimmed (see
+// sprite.c) by a pool of worker threads and finally uploaded on the render
+// thread in asset_loader_pump(). Assets found in the baked pack skip the read
+// and decode steps. Assets requested with LOAD_ATLAS are packed into the
+// shared atlas instead of getting their own texture. Assets with a display
+// size get a box-filtered mip chain that starts at the level matching that
+// size, so art drawn far below its resolution is never uploaded at full size,
+// and ends at the smallest size it is drawn at.
+// Fully opaque art loses its alpha channel (XRGB8888, or RGB565 at
+// TEXTURE_QUALITY_LOW) and is drawn with blending off, everything else is
+// premultiplied before the mips are built and drawn with
+// SDL_BLENDMODE_BLEND_PREMULTIPLIED.
+// Callers get a TexHandle right away; until the texture behind it has been
+// uploaded, asset_loader_get_sheet() and asset_loader_get_sprite() return an
+// empty sheet or sprite, which sheet_is_loaded() rejects.
+
+#define LOADER_MAX_ASSETS  64
+#define LOADER_MAX_WORKERS 16
+
+typedef s32 TexHandle;
+#define INVALID_TEX_HANDLE -1
+
+enum LoadFlags {
+  LOAD_DEFAULT = 0,
+  LOAD_ATLAS   = (1 << 0),
+};
+
+typedef struct {
+  u32 flags;
+  int cols;          // sheet layout, 0 means 1
+  int rows;
+  int cell_w;        // 0 splits the image evenly
+  int cell_h;
+  v2 display_dims;   // largest on-screen size of one frame, 0 = native size, no mips
+  v2 min_display_dims; // smallest on-screen size, 0 = display_dims, decides how many mips get built
+} LoadParams;
+
+enum TextureQuality {
+  TEXTURE_QUALITY_HIGH, // opaque art as XRGB8888
+  TEXTURE_QUALITY_LOW,  // opaque art as RGB565
+};
+
+enum LoaderState {
+  LOADER_EMPTY,
+  LOADER_READING,  // waiting on async io
+  LOADER_QUEUED,   // file or pack pixels in memory, waiting for a worker
+  LOADER_DECODING,
+  LOADER_DECODED,  // trimmed pixels ready, waiting for upload on the render thread
+  LOADER_PACKED,   // copied into an atlas page, waiting for the page upload
+  LOADER_READY,
+  LOADER_FAILED,
+};
+
+enum PixelOwner {
+  PIXELS_NONE,
+  PIXELS_PACK, // points into the mapping, must not be freed
+  PIXELS_STBI,
+};
+
+typedef struct {
+  char name[ASSET_PACK_NAME_SIZE];
+  LoadParams params;
+  SDL_AtomicInt state;
+
+  void *file_data;
+  size_t file_size;
+
+  b8 from_pack;
+  Image image;
+  enum PixelOwner image_owner;
+  TrimmedSheet trimmed;
+
+  // mip_images[0] is the finest level that gets uploaded (base_level), the
+  // rest follow at half size each. mip_images[0] may alias trimmed.image,
+  // the coarser levels are always owned.
+  int base_level;
+  int num_mips;
+  Image mip_images[MAX_SPRITE_MIPS + 1];
+  b8 mip0_owned;
+
+  enum AlphaClass alpha;
+  SDL_PixelFormat format; // of mip_images and the textures made from them
+
+  SpriteSheet sheet;
+  int frame_pages[MAX_SHEET_FRAMES];
+  b8 resolved; // uploaded or failed, render thread only
+
+  u64 bytes;   // texture memory of every uploaded level, 0 for atlas assets
+
+  u64 requested_at;
+  f64 decode_ms;
+  f64 trim_ms;
+} LoaderAsset;
+
+typedef struct {
+  SDL_Renderer *renderer;
+  AssetPack *pack;
+  Atlas *atlas;
+  ResourceRegistry *resources;
+  SDL_AsyncIOQueue *io_queue;
+  enum TextureQuality quality;
+
+  SDL_Thread *workers[LOADER_MAX_WORKERS];
+  int num_workers;
+
+  SDL_Mutex *mutex;
+  SDL_Condition *work_available;
+  int decode_queue[LOADER_MAX_ASSETS];
+  int decode_queue_head;
+  int decode_queue_count;
+  b8 quit;
+
+  LoaderAsset assets[LOADER_MAX_ASSETS];
+  int num_assets;
+  int num_pending;
+} AssetLoader;
+
+static f64 loader_ms_since(u64 start) {
+  return (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+static void asset_loader_free_source(LoaderAsset *asset) {
+  if (asset->image_owner == PIXELS_STBI) stbi_image_free(asset->image.pixels);
+  asset->image = (Image){0};
+  asset->image_owner = PIXELS_NONE;
+}
+
+static void asset_loader_free_trimmed(LoaderAsset *asset) {
+  for (int i = 0; i <= asset->num_mips; ++i)
+    if (i > 0 || asset->mip0_owned) SDL_free(asset->mip_images[i].pixels);
+  SDL_zeroa(asset->mip_images);
+  asset->num_mips = 0;
+  asset->mip0_owned = false;
+
+  if (asset->trimmed.owns_pixels) SDL_free(asset->trimmed.image.pixels);
+  SDL_zero(asset->trimmed);
+}
+
+// Chooses the first uploaded level from the display size and how many
+// coarser levels follow it. Returns the alignment trim_sheet() needs for that.
+static int asset_loader_plan_mips(LoaderAsset *asset, int cell_w, int cell_h) {
+  asset->base_level = 0;
+  asset->num_mips = 0;
+
+  v2 display = asset->params.display_dims;
+  if ((asset->params.flags & LOAD_ATLAS) || display.x <= 0 || display.y <= 0) return 1;
+
+  while (asset->base_level < 4
+         && (cell_w >> (asset->base_level + 1)) >= display.x
+         && (cell_h >> (asset->base_level + 1)) >= display.y)
+    asset->base_level++;
+
+  //NOTE: sprite_pick_mip() only takes a level once the one above it is at
+  // least twice the drawn size, levels below the smallest size are never used.
+  v2 min_display = asset->params.min_display_dims;
+  if (min_display.x <= 0 || min_display.y <= 0) min_display = display;
+  while (asset->num_mips < MAX_SPRITE_MIPS
+         && (cell_w >> (asset->base_level + asset->num_mips + 1)) >= min_display.x
+         && (cell_h >> (asset->base_level + asset->num_mips + 1)) >= min_display.y
+         && (MIN(cell_w, cell_h) >> (asset->base_level + asset->num_mips + 1)) >= 16)
+    asset->num_mips++;
+
+  return 1 << (asset->base_level + asset->num_mips);
+}
+
+static b8 asset_loader_build_mips(LoaderAsset *asset) {
+  Image level = asset->trimmed.image;
+  for (int i = 1; i <= asset->base_level; ++i) {
+    Image next;
+    if (!image_downsample_2x(&level, &next)) return false;
+    if (i > 1) SDL_free(level.pixels);
+    level = next;
+  }
+  asset->mip_images[0] = level;
+  asset->mip0_owned = asset->base_level > 0;
+
+  for (int i = 1; i <= asset->num_mips; ++i) {
+    if (!image_downsample_2x(&asset->mip_images[i - 1], &asset->mip_images[i])) {
+      asset->num_mips = i - 1;
+      return false;
+    }
+  }
+  return true;
+}
+
+// Opaque levels are swapped for copies without alpha. Atlas pages are shared
+// with translucent sprites, so atlas assets stay RGBA32.
+static b8 asset_loader_drop_alpha(LoaderAsset *asset, SDL_PixelFormat format) {
+  for (int i = 0; i <= asset->num_mips; ++i) {
+    Image converted;
+    if (!image_convert_opaque(&asset->mip_images[i], &converted, format)) return false;
+    if (i > 0 || asset->mip0_owned) SDL_free(asset->mip_images[i].pixels);
+    asset->mip_images[i] = converted;
+  }
+  asset->mip0_owned = true;
+  asset->format = format;
+  return true;
+}
+
+// Works in place when the trimmed pixels are ours, pack pixels are read only
+// and get copied first.
+static b8 asset_loader_premultiply(LoaderAsset *asset) {
+  Image *image = &asset->trimmed.image;
+  if (!asset->trimmed.owns_pixels && asset->image_owner != PIXELS_STBI) {
+    Image copy = { .width = image->width, .height = image->height, .pitch = image->width * 4 };
+    copy.pixels = SDL_malloc((size_t)copy.pitch * copy.height);
+    if (!copy.pixels) return false;
+    image_premultiply_alpha(image, &copy);
+    *image = copy;
+    asset->trimmed.owns_pixels = true;
+    return true;
+  }
+
+  image_premultiply_alpha(image, image);
+  return true;
+}
+
+static SDL_FRect scale_cell(SDL_Rect cell, int level) {
+  int round = (1 << level) - 1;
+  return (SDL_FRect){ cell.x >> level, cell.y >> level, (cell.w + round) >> level, (cell.h + round) >> level };
+}
+
+static void asset_loader_process(AssetLoader *loader, LoaderAsset *asset) {
+  if (asset->file_data) {
+    u64 start = SDL_GetPerformanceCounter();
+    int channels;
+    Image *image = &asset->image;
+    image->pixels = stbi_load_from_memory(asset->file_data, (int)asset->file_size, &image->width, &image->height, &channels, 4);
+    image->pitch = image->width * 4;
+    asset->image_owner = image->pixels ? PIXELS_STBI : PIXELS_NONE;
+    asset->decode_ms = loader_ms_since(start);
+
+    SDL_free(asset->file_data);
+    asset->file_data = NULL;
+
+    if (!image->pixels) {
+      SDL_Log("%s not decoded: %s", asset->name, stbi_failure_reason());
+      SDL_SetAtomicInt(&asset->state, LOADER_FAILED);
+      return;
+    }
+  }
+
+  u64 start = SDL_GetPerformanceCounter();
+  LoadParams *params = &asset->params;
+  int cell_w = params->cell_w ? params->cell_w : asset->image.width / params->cols;
+  int cell_h = params->cell_h ? params->cell_h : asset->image.height / params->rows;
+  int align = asset_loader_plan_mips(asset, cell_w, cell_h);
+  if (!trim_sheet(&asset->image, params->cols, params->rows, cell_w, cell_h, align, &asset->trimmed)) {
+    SDL_Log("%s could not be trimmed", asset->name);
+    asset_loader_free_source(asset);
+    SDL_SetAtomicInt(&asset->state, LOADER_FAILED);
+    return;
+  }
+
+  asset->alpha = image_alpha_class(&asset->trimmed.image);
+  if (asset->alpha != ALPHA_OPAQUE && !asset_loader_premultiply(asset)) {
+    SDL_Log("%s: premultiplied copy could not be made", asset->name);
+    asset_loader_free_trimmed(asset);
+    asset_loader_free_source(asset);
+    SDL_SetAtomicInt(&asset->state, LOADER_FAILED);
+    return;
+  }
+
+  if (!asset_loader_build_mips(asset)) {
+    SDL_Log("%s: mip chain could not be built", asset->name);
+    asset_loader_free_trimmed(asset);
+    asset_loader_free_source(asset);
+    SDL_SetAtomicInt(&asset->state, LOADER_FAILED);
+    return;
+  }
+
+  // Box filtering turns cutout edges into partial alpha.
+  if (asset->alpha == ALPHA_BINARY && asset->base_level > 0) asset->alpha = ALPHA_BLENDED;
+
+  asset->format = SDL_PIXELFORMAT_RGBA32;
+  if (asset->alpha == ALPHA_OPAQUE && !(params->flags & LOAD_ATLAS)) {
+    SDL_PixelFormat format = loader->quality == TEXTURE_QUALITY_LOW ? SDL_PIXELFORMAT_RGB565 : SDL_PIXELFORMAT_XRGB8888;
+    if (!asset_loader_drop_alpha(asset, format)) {
+      SDL_Log("%s: opaque copy could not be made", asset->name);
+      asset_loader_free_trimmed(asset);
+      asset_loader_free_source(asset);
+      SDL_SetAtomicInt(&asset->state, LOADER_FAILED);
+      return;
+    }
+  }
+
+  SpriteSheet *sheet = &asset->sheet;
+  sheet->cols = params->cols;
+  sheet->rows = params->rows;
+  sheet->frame_dims = (v2){ .x = cell_w, .y = cell_h };
+  sheet->image_dims = (v2){ .x = asset->image.width, .y = asset->image.height };
+  for (int i = 0; i < asset->trimmed.num_frames; ++i) {
+    SDL_Rect cell = asset->trimmed.cells[i];
+    SDL_Rect trim = asset->trimmed.trims[i];
+    Sprite *frame = &sheet->frames[i];
+    *frame = (Sprite){
+      .src = scale_cell(cell, asset->base_level),
+      .trim = { trim.x, trim.y, trim.w, trim.h },
+      .frame_dims = sheet->frame_dims,
+      .alpha = asset->alpha,
+      .level = asset->base_level,
+      .num_mips = asset->num_mips,
+    };
+    for (int m = 0; m < asset->num_mips; ++m)
+      frame->mips[m].src = scale_cell(cell, asset->base_level + 1 + m);
+  }
+
+  // The trimmed copy (or the mips made from it) is all we need from here on.
+  if (asset->trimmed.owns_pixels || asset->mip0_owned) asset_loader_free_source(asset);
+  if (asset->mip0_owned && asset->trimmed.owns_pixels) {
+    SDL_free(asset->trimmed.image.pixels);
+    asset->trimmed.image.pixels = NULL;
+  }
+  asset->trim_ms = loader_ms_since(start);
+
+  SDL_SetAtomicInt(&asset->state, LOADER_DECODED);
+}
+
+static int asset_loader_worker(void *userdata) {
+  AssetLoader *loader = userdata;
+  PROFILE_THREAD_NAME("asset loader");
+
+  for (;;) {
+    SDL_LockMutex(loader->mutex);
+    while (!loader->quit && loader->decode_queue_count == 0)
+      SDL_WaitCondition(loader->work_available, loader->mutex);
+
+    if (loader->quit) {
+      SDL_UnlockMutex(loader->mutex);
+      return 0;
+    }
+
+    int index = loader->decode_queue[loader->decode_queue_head];
+    loader->decode_queue_head = (loader->decode_queue_head + 1) % LOADER_MAX_ASSETS;
+    loader->decode_queue_count--;
+    SDL_UnlockMutex(loader->mutex);
+
+    LoaderAsset *asset = &loader->assets[index];
+    SDL_SetAtomicInt(&asset->state, LOADER_DECODING);
+    PROFILE_SCOPE("decode") asset_loader_process(loader, asset);
+  }
+}
+
+static void asset_loader_enqueue(AssetLoader *loader, LoaderAsset *asset) {
+  SDL_SetAtomicInt(&asset->state, LOADER_QUEUED);
+
+  SDL_LockMutex(loader->mutex);
+  int tail = (loader->decode_queue_head + loader->decode_queue_count) % LOADER_MAX_ASSETS;
+  loader->decode_queue[tail] = (int)(asset - loader->assets);
+  loader->decode_queue_count++;
+  SDL_SignalCondition(loader->work_available);
+  SDL_UnlockMutex(loader->mutex);
+}
+
+b8 asset_loader_init(AssetLoader *loader, SDL_Renderer *renderer, AssetPack *pack, Atlas *atlas, ResourceRegistry *resources) {
+  SDL_zerop(loader);
+  loader->renderer = renderer;
+  loader->pack = pack;
+  loader->atlas = atlas;
+  loader->resources = resources;
+
+  loader->io_queue = SDL_CreateAsyncIOQueue();
+  loader->mutex = SDL_CreateMutex();
+  loader->work_available = SDL_CreateCondition();
+  if (!loader->io_queue || !loader->mutex || !loader->work_available) {
+    SDL_Log("Asset loader could not be created: %s", SDL_GetError());
+    return false;
+  }
+
+  // Leave one core for the render thread, which does the uploads.
+  int num_workers = SDL_GetNumLogicalCPUCores() - 1;
+  num_workers = num_workers < 1 ? 1 : num_workers;
+  num_workers = num_workers > LOADER_MAX_WORKERS ? LOADER_MAX_WORKERS : num_workers;
+
+  for (int i = 0; i < num_workers; ++i) {
+    SDL_Thread *thread = SDL_CreateThread(asset_loader_worker, "asset decode", loader);
+    if (!thread) {
+      SDL_Log("Asset decode thread could not be created: %s", SDL_GetError());
+      break;
+    }
+    loader->workers[loader->num_workers++] = thread;
+  }
+
+  if (loader->num_workers == 0) return false;
+
+  SDL_Log("Asset loader: %d decode workers", loader->num_workers);
+  return true;
+}
+
+// Only affects assets requested afterwards.
+void asset_loader_set_quality(AssetLoader *loader, enum TextureQuality quality) {
+  loader->quality = quality;
+}
+
+// Requests a sheet of params->cols*rows frames; every frame is trimmed on its own.
+TexHandle asset_loader_request_ex(AssetLoader *loader, const char *name, LoadParams *params) {
+  TexHandle handle = INVALID_TEX_HANDLE;
+  for (int i = 0; i < loader->num_assets; ++i) {
+    if (SDL_strcmp(loader->assets[i].name, name) == 0) {
+      if (SDL_GetAtomicInt(&loader->assets[i].state) != LOADER_EMPTY) return i;
+      handle = i; // released earlier, load it again into the same slot
+      break;
+    }
+  }
+
+  LoadParams p = *params;
+  p.cols = MAX(p.cols, 1);
+  p.rows = MAX(p.rows, 1);
+  if ((handle < 0 && loader->num_assets >= LOADER_MAX_ASSETS) || SDL_strlen(name) >= ASSET_PACK_NAME_SIZE || p.cols * p.rows > MAX_SHEET_FRAMES) {
+    SDL_Log("Asset loader cannot take %s", name);
+    return INVALID_TEX_HANDLE;
+  }
+
+  if (handle < 0) handle = loader->num_assets++;
+  LoaderAsset *asset = &loader->assets[handle];
+  SDL_strlcpy(asset->name, name, sizeof(asset->name));
+  asset->params = p;
+  asset->requested_at = SDL_GetPerformanceCounter();
+  loader->num_pending++;
+
+  AssetPackEntry *entry = asset_pack_find(loader->pack, name);
+  if (entry && entry->format == ASSET_PACK_RGBA32) {
+    asset->image = (Image){
+      .pixels = loader->pack->base + entry->offset,
+      .width  = entry->width,
+      .height = entry->height,
+      .pitch  = entry->pitch,
+    };
+    asset->image_owner = PIXELS_PACK;
+    asset->from_pack = true;
+    asset_loader_enqueue(loader, asset);
+    return handle;
+  }
+
+  char path[256];
+  SDL_snprintf(path, sizeof(path), "../res/%s", name);
+  SDL_SetAtomicInt(&asset->state, LOADER_READING);
+  if (!SDL_LoadFileAsync(path, loader->io_queue, asset)) {
+    SDL_Log("%s not loaded: %s", path, SDL_GetError());
+    SDL_SetAtomicInt(&asset->state, LOADER_FAILED);
+  }
+
+  return handle;
+}
+
+TexHandle asset_loader_request(AssetLoader *loader, const char *name, u32 flags) {
+  return asset_loader_request_ex(loader, name, &(LoadParams){ .flags = flags });
+}
+
+static void asset_loader_log(LoaderAsset *asset) {
+  static const char *alpha_names[] = { "opaque", "1-bit", "alpha" };
+  SDL_Log("load %-32s %-4s %8.3f ms (decode %.3f ms, trim %.3f ms) %.0fx%.0f -> %dx%d, level %d + %d mips, %s %s",
+          asset->name, asset->from_pack ? "pack" : "png",
+          loader_ms_since(asset->requested_at), asset->decode_ms, asset->trim_ms,
+          asset->sheet.image_dims.x, asset->sheet.image_dims.y,
+          asset->mip_images[0].width, asset->mip_images[0].height, asset->base_level, asset->num_mips,
+          alpha_names[asset->alpha], SDL_GetPixelFormatName(asset->format) + SDL_strlen("SDL_PIXELFORMAT_"));
+}
+
+static SDL_Texture *asset_loader_create_texture(AssetLoader *loader, LoaderAsset *asset, Image *image, enum ResourceCategory category) {
+  SDL_Texture *texture = SDL_CreateTexture(loader->renderer, asset->format, SDL_TEXTUREACCESS_STATIC, image->width, image->height);
+  if (!texture) {
+    SDL_Log("Texture could not be created for %s. Error: %s", asset->name, SDL_GetError());
+    return NULL;
+  }
+
+  SDL_UpdateTexture(texture, NULL, image->pixels, image->pitch);
+  soft_texture_attach(texture, image->pixels, image->pitch, asset->format, asset->alpha);
+  // Skipping the blend is the actual win for the software renderer, it turns
+  // the blit into a plain copy.
+  SDL_SetTextureBlendMode(texture, asset->alpha == ALPHA_OPAQUE ? SDL_BLENDMODE_NONE : SDL_BLENDMODE_BLEND_PREMULTIPLIED);
+  resources_track_texture(loader->resources, texture, asset->name, category);
+  asset->bytes += (u64)image->width * image->height * SDL_BYTESPERPIXEL(asset->format);
+  return texture;
+}
+
+static void asset_loader_upload(AssetLoader *loader, LoaderAsset *asset) {
+  SDL_Texture *texture = asset_loader_create_texture(loader, asset, &asset->mip_images[0], RESOURCE_TEXTURE);
+  for (int i = 0; i < asset->trimmed.num_frames; ++i)
+    asset->sheet.frames[i].texture = texture;
+
+  for (int m = 0; m < asset->num_mips; ++m) {
+    SDL_Texture *mip = texture ? asset_loader_create_texture(loader, asset, &asset->mip_images[m + 1], RESOURCE_MIP) : NULL;
+    for (int i = 0; i < asset->trimmed.num_frames; ++i) {
+      Sprite *frame = &asset->sheet.frames[i];
+      frame->mips[m].texture = mip;
+      if (!mip) frame->num_mips = MIN(frame->num_mips, m);
+    }
+  }
+
+  SDL_SetAtomicInt(&asset->state, texture ? LOADER_READY : LOADER_FAILED);
+  asset_loader_log(asset);
+
+  asset_loader_free_trimmed(asset);
+  asset_loader_free_source(asset);
+}
+
+// Returns false if a frame does not fit into the atlas, the caller then falls
+// back to a texture of its own. Checked up front, so no frame of the sheet
+// takes atlas space in that case.
+static b8 asset_loader_pack(AssetLoader *loader, LoaderAsset *asset) {
+  if (!loader->atlas) return false;
+  if (!atlas_fits(loader->atlas, asset->trimmed.cells, asset->trimmed.num_frames)) return false;
+
+  Image *image = &asset->mip_images[0];
+  SDL_FRect placed[MAX_SHEET_FRAMES];
+  for (int i = 0; i < asset->trimmed.num_frames; ++i) {
+    SDL_Rect cell = asset->trimmed.cells[i];
+    placed[i] = (SDL_FRect){0};
+    if (cell.w <= 0) continue;
+
+    u8 *pixels = image->pixels + (size_t)cell.y * image->pitch + (size_t)cell.x * 4;
+    if (!atlas_add(loader->atlas, pixels, cell.w, cell.h, image->pitch, &asset->frame_pages[i], &placed[i]))
+      return false;
+  }
+
+  for (int i = 0; i < asset->trimmed.num_frames; ++i)
+    asset->sheet.frames[i].src = placed[i];
+
+  asset_loader_log(asset);
+  asset_loader_free_trimmed(asset);
+  asset_loader_free_source(asset);
+  SDL_SetAtomicInt(&asset->state, LOADER_PACKED);
+  return true;
+}
+
+// Render thread only. Hands finished reads to the decode workers and uploads
+// everything that has been decoded since the last call.
+void asset_loader_pump(AssetLoader *loader) {
+  SDL_AsyncIOOutcome outcome;
+  while (SDL_GetAsyncIOResult(loader->io_queue, &outcome)) {
+    LoaderAsset *asset = outcome.userdata;
+    if (outcome.result != SDL_ASYNCIO_COMPLETE) {
+      SDL_Log("%s not read: %s", asset->name, SDL_GetError());
+      SDL_free(outcome.buffer);
+      SDL_SetAtomicInt(&asset->state, LOADER_FAILED);
+      continue;
+    }
+
+    asset->file_data = outcome.buffer;
+    asset->file_size = (size_t)outcome.bytes_transferred;
+    asset_loader_enqueue(loader, asset);
+  }
+
+  int num_atlas_waiting = 0;
+  for (int i = 0; i < loader->num_assets; ++i) {
+    LoaderAsset *asset = &loader->assets[i];
+    if (asset->resolved) continue;
+
+    int state = SDL_GetAtomicInt(&asset->state);
+    if (state == LOADER_DECODED) {
+      if ((asset->params.flags & LOAD_ATLAS) && asset_loader_pack(loader, asset)) continue;
+      asset_loader_upload(loader, asset);
+    } else if (state == LOADER_PACKED) {
+      continue;
+    } else if (state != LOADER_FAILED) {
+      if (asset->params.flags & LOAD_ATLAS) num_atlas_waiting++;
+      continue;
+    }
+
+    asset->resolved = true;
+    loader->num_pending--;
+  }
+
+  // Atlas pages go up once nothing else is headed for them, so each page is
+  // uploaded once instead of once per sprite.
+  if (num_atlas_waiting == 0 && loader->atlas) {
+    atlas_upload(loader->atlas, loader->renderer, loader->resources);
+
+    for (int i = 0; i < loader->num_assets; ++i) {
+      LoaderAsset *asset = &loader->assets[i];
+      if (asset->resolved || SDL_GetAtomicInt(&asset->state) != LOADER_PACKED) continue;
+
+      b8 ok = true;
+      for (int f = 0; f < asset->sheet.cols * asset->sheet.rows; ++f) {
+        Sprite *frame = &asset->sheet.frames[f];
+        if (frame->src.w <= 0) continue;
+        frame->texture = loader->atlas->pages[asset->frame_pages[f]].texture;
+        ok = ok && frame->texture;
+      }
+      SDL_SetAtomicInt(&asset->state, ok ? LOADER_READY : LOADER_FAILED);
+
+      asset->resolved = true;
+      loader->num_pending--;
+    }
+  }
+}
+
+b8 asset_loader_done(AssetLoader *loader) {
+  return loader->num_pending == 0;
+}
+
+// Blocks until every requested asset is either uploaded or has failed.
+void asset_loader_wait_all(AssetLoader *loader) {
+  for (;;) {
+    asset_loader_pump(loader);
+    if (asset_loader_done(loader)) break;
+    SDL_Delay(1);
+  }
+}
+
+// Returns an empty sheet (all textures NULL) until the asset is ready.
+SpriteSheet asset_loader_get_sheet(AssetLoader *loader, TexHandle handle) {
+  if (handle < 0 || handle >= loader->num_assets) return (SpriteSheet){0};
+
+  LoaderAsset *asset = &loader->assets[handle];
+  return SDL_GetAtomicInt(&asset->state) == LOADER_READY ? asset->sheet : (SpriteSheet){0};
+}
+
+Sprite asset_loader_get_sprite(AssetLoader *loader, TexHandle handle) {
+  return asset_loader_get_sheet(loader, handle).frames[0];
+}
+
+b8 asset_loader_failed(AssetLoader *loader, TexHandle handle) {
+  return handle < 0 || handle >= loader->num_assets || SDL_GetAtomicInt(&loader->assets[handle].state) == LOADER_FAILED;
+}
+
+u64 asset_loader_bytes(AssetLoader *loader, TexHandle handle) {
+  if (handle < 0 || handle >= loader->num_assets) return 0;
+  return loader->assets[handle].bytes;
+}
+
+// Destroys the textures of a finished asset and frees its slot, so the same
+// name can be requested again later. In-flight assets cannot be released.
+b8 asset_loader_release(AssetLoader *loader, TexHandle handle) {
+  if (handle < 0 || handle >= loader->num_assets) return false;
+
+  LoaderAsset *asset = &loader->assets[handle];
+  if (!asset->resolved) return false;
+
+  if (!(asset->params.flags & LOAD_ATLAS) && asset->sheet.cols > 0) {
+    Sprite *frame = &asset->sheet.frames[0];
+    resources_release(loader->resources, frame->texture, RESOURCE_TEXTURE);
+    for (int m = 0; m < frame->num_mips; ++m)
+      resources_release(loader->resources, frame->mips[m].texture, RESOURCE_MIP);
+  }
+
+  char name[ASSET_PACK_NAME_SIZE];
+  SDL_strlcpy(name, asset->name, sizeof(name));
+  SDL_zerop(asset);
+  SDL_strlcpy(asset->name, name, sizeof(asset->name));
+  return true;
+}
+
+// Stops the workers. Textures stay alive, whoever requested them releases
+// them with asset_loader_release() (atlas pages go with the atlas).
+void asset_loader_shutdown(AssetLoader *loader) {
+  SDL_LockMutex(loader->mutex);
+  loader->quit = true;
+  SDL_BroadcastCondition(loader->work_available);
+  SDL_UnlockMutex(loader->mutex);
+
+  for (int i = 0; i < loader->num_workers; ++i)
+    SDL_WaitThread(loader->workers[i], NULL);
+
+  for (int i = 0; i < loader->num_assets; ++i) {
+    LoaderAsset *asset = &loader->assets[i];
+    SDL_free(asset->file_data);
+    asset_loader_free_trimmed(asset);
+    asset_loader_free_source(asset);
+  }
+
+  SDL_DestroyAsyncIOQueue(loader->io_queue);
+  SDL_DestroyCondition(loader->work_available);
+  SDL_DestroyMutex(loader->mutex);
+}
@@ -0,0 +1,142 @@
+// Runtime side of the baked asset pack (see asset_pack_format.h and bake.c).
+// The whole pack is mapped read-only and texture uploads read straight out of
+// the mapping, so loading an asset is just an index lookup plus SDL_UpdateTexture
+// (see asset_loader.c). Embedded builds (make embedded) link the pack into
+// the executable instead and open it with asset_pack_open_memory().
+
+#include "asset_pack_format.h"
+
+#ifdef SDL_PLATFORM_WINDOWS
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+typedef struct {
+  u8 *base;
+  u64 size;
+  AssetPackHeader *header;
+  AssetPackEntry *entries;
+  b8 embedded; // base points into the executable, nothing to unmap
+
+#ifdef SDL_PLATFORM_WINDOWS
+  HANDLE file;
+  HANDLE mapping;
+#endif
+} AssetPack;
+
+static b8 asset_pack_map_file(AssetPack *pack, const char *filename) {
+#ifdef SDL_PLATFORM_WINDOWS
+  pack->file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (pack->file == INVALID_HANDLE_VALUE) return false;
+
+  LARGE_INTEGER file_size;
+  if (!GetFileSizeEx(pack->file, &file_size)) return false;
+  pack->size = (u64)file_size.QuadPart;
+
+  pack->mapping = CreateFileMappingA(pack->file, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (!pack->mapping) return false;
+
+  pack->base = MapViewOfFile(pack->mapping, FILE_MAP_READ, 0, 0, 0);
+  return pack->base != NULL;
+#else
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) return false;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return false;
+  }
+  pack->size = (u64)st.st_size;
+
+  void *base = mmap(NULL, pack->size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) return false;
+
+  pack->base = base;
+  return true;
+#endif
+}
+
+void asset_pack_close(AssetPack *pack) {
+  if (pack->embedded) {
+    SDL_zerop(pack);
+    return;
+  }
+
+#ifdef SDL_PLATFORM_WINDOWS
+  if (pack->base) UnmapViewOfFile(pack->base);
+  if (pack->mapping) CloseHandle(pack->mapping);
+  if (pack->file && pack->file != INVALID_HANDLE_VALUE) CloseHandle(pack->file);
+#else
+  if (pack->base) munmap(pack->base, pack->size);
+#endif
+  SDL_zerop(pack);
+}
+
+static b8 asset_pack_validate(AssetPack *pack, const char *filename) {
+  AssetPackHeader *header = (AssetPackHeader *)pack->base;
+  if (pack->size < sizeof(AssetPackHeader)
+      || header->magic != ASSET_PACK_MAGIC
+      || header->version != ASSET_PACK_VERSION
+      || header->header_size != sizeof(AssetPackHeader)
+      || header->file_size != pack->size
+      || sizeof(AssetPackHeader) + (u64)header->entry_count * sizeof(AssetPackEntry) > pack->size) {
+    SDL_Log("Asset pack %s is invalid or outdated, rebuild it with 'make pack'", filename);
+    asset_pack_close(pack);
+    return false;
+  }
+
+  pack->header  = header;
+  pack->entries = (AssetPackEntry *)(pack->base + sizeof(AssetPackHeader));
+
+  for (u32 i = 0; i < header->entry_count; ++i) {
+    AssetPackEntry *entry = &pack->entries[i];
+    if (entry->offset + entry->size > pack->size || (u64)entry->pitch * entry->height > entry->size) {
+      SDL_Log("Asset pack %s: entry %u is out of bounds", filename, i);
+      asset_pack_close(pack);
+      return false;
+    }
+  }
+
+  SDL_Log("Asset pack %s: %u assets, %.2f MB", filename, header->entry_count, pack->size / (1024.0 * 1024.0));
+  return true;
+}
+
+b8 asset_pack_open(AssetPack *pack, const char *filename) {
+  SDL_zerop(pack);
+
+  if (!asset_pack_map_file(pack, filename)) {
+    SDL_Log("Asset pack %s not available, falling back to PNGs", filename);
+    asset_pack_close(pack);
+    return false;
+  }
+
+  return asset_pack_validate(pack, filename);
+}
+
+// The pack is read in place, data has to stay alive (and 64 byte aligned)
+// for as long as the pack is open.
+b8 asset_pack_open_memory(AssetPack *pack, const u8 *data, u64 size) {
+  SDL_zerop(pack);
+  pack->base = (u8 *)data;
+  pack->size = size;
+  pack->embedded = true;
+
+  return asset_pack_validate(pack, "(embedded)");
+}
+
+AssetPackEntry *asset_pack_find(AssetPack *pack, const char *name) {
+  if (!pack->header) return NULL;
+
+  for (u32 i = 0; i < pack->header->entry_count; ++i) {
+    if (SDL_strncmp(pack->entries[i].name, name, ASSET_PACK_NAME_SIZE) == 0)
+      return &pack->entries[i];
+  }
+  return NULL;
+}
@@ -0,0 +1,43 @@
+#ifndef ASSET_PACK_FORMAT_H
+#define ASSET_PACK_FORMAT_H
+
+#include <stdint.h>
+
+// On-disk layout of build/assets.pack, written by code/bake.c and read by
+// code/asset_pack.c. Everything is little endian and the file is meant to be
+// mapped as a whole, so all offsets are relative to the start of the file.
+//
+//   AssetPackHeader
+//   AssetPackEntry[entry_count]
+//   pixel data, every blob starts on an ASSET_PACK_ALIGNMENT boundary
+//
+// Bump ASSET_PACK_VERSION whenever any of these structs change.
+
+#define ASSET_PACK_MAGIC     0x4b504444u // "DDPK"
+#define ASSET_PACK_VERSION   1u
+#define ASSET_PACK_ALIGNMENT 64u
+#define ASSET_PACK_NAME_SIZE 48
+
+enum AssetPackPixelFormat {
+  ASSET_PACK_RGBA32 = 1, // matches SDL_PIXELFORMAT_RGBA32, 4 bytes per pixel
+};
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t entry_count;
+  uint32_t header_size; // sizeof(AssetPackHeader), sanity check
+  uint64_t file_size;
+} AssetPackHeader;
+
+typedef struct {
+  char     name[ASSET_PACK_NAME_SIZE]; // file name inside res/, e.g. "item_duck.png"
+  uint32_t width;
+  uint32_t height;
+  uint32_t pitch;
+  uint32_t format;
+  uint64_t offset;
+  uint64_t size;
+} AssetPackEntry;
+
+#endif
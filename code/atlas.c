@@ -0,0 +1,230 @@
+// Runtime texture atlas. Small sprites are packed into a few large pages with
+// a bottom-left skyline packer, so props and belt decorations share textures
+// instead of each sprite switching to its own.
+//
+// Pixels are staged on the CPU while sprites are added and the dirty pages
+// are uploaded in one go by atlas_upload(). Sprites come in premultiplied
+// (see asset_loader.c), so pages blend with SDL_BLENDMODE_BLEND_PREMULTIPLIED.
+
+#define ATLAS_PAGE_SIZE    2048
+#define ATLAS_MAX_PAGES    4
+#define ATLAS_MAX_SKYLINE  256
+#define ATLAS_PADDING      2   // transparent gutter against filtering bleed
+
+typedef struct {
+  s32 x;
+  s32 y;
+  s32 w;
+} SkylineNode;
+
+typedef struct {
+  SkylineNode nodes[ATLAS_MAX_SKYLINE];
+  int num_nodes;
+  int width;
+  int height;
+
+  u8 *pixels;  // RGBA32 staging copy, freed after the last upload
+  b8 dirty;
+  SDL_Texture *texture;
+} AtlasPage;
+
+typedef struct {
+  AtlasPage pages[ATLAS_MAX_PAGES];
+  int num_pages;
+} Atlas;
+
+static void skyline_init(AtlasPage *page, int width, int height) {
+  page->width  = width;
+  page->height = height;
+  page->num_nodes = 1;
+  page->nodes[0] = (SkylineNode){ .x = 0, .y = 0, .w = width };
+}
+
+// Returns the lowest y at which a w*h rect fits when its left edge sits on
+// node index, or -1 if it does not fit there at all.
+static int skyline_fit(AtlasPage *page, int index, int w, int h) {
+  int x = page->nodes[index].x;
+  if (x + w > page->width) return -1;
+
+  int y = 0;
+  int width_left = w;
+  for (int i = index; width_left > 0; ++i) {
+    if (i >= page->num_nodes) return -1;
+    y = MAX(y, page->nodes[i].y);
+    if (y + h > page->height) return -1;
+    width_left -= page->nodes[i].w;
+  }
+  return y;
+}
+
+static b8 skyline_insert(AtlasPage *page, int w, int h, int *out_x, int *out_y) {
+  int best_index = -1;
+  int best_y = 0;
+  int best_w = 0;
+
+  // Bottom-left: lowest top edge wins, ties go to the narrower segment.
+  for (int i = 0; i < page->num_nodes; ++i) {
+    int y = skyline_fit(page, i, w, h);
+    if (y < 0) continue;
+    if (best_index < 0 || y < best_y || (y == best_y && page->nodes[i].w < best_w)) {
+      best_index = i;
+      best_y = y;
+      best_w = page->nodes[i].w;
+    }
+  }
+
+  if (best_index < 0 || page->num_nodes >= ATLAS_MAX_SKYLINE) return false;
+
+  int x = page->nodes[best_index].x;
+
+  SDL_memmove(&page->nodes[best_index + 1], &page->nodes[best_index], (page->num_nodes - best_index) * sizeof(SkylineNode));
+  page->nodes[best_index] = (SkylineNode){ .x = x, .y = best_y + h, .w = w };
+  page->num_nodes++;
+
+  // Cut away everything the new node now shadows.
+  for (int i = best_index + 1; i < page->num_nodes; ) {
+    SkylineNode *prev = &page->nodes[i - 1];
+    SkylineNode *node = &page->nodes[i];
+    int shadow = prev->x + prev->w - node->x;
+    if (shadow <= 0) break;
+
+    node->x += shadow;
+    node->w -= shadow;
+    if (node->w > 0) break;
+
+    SDL_memmove(node, node + 1, (page->num_nodes - i - 1) * sizeof(SkylineNode));
+    page->num_nodes--;
+  }
+
+  // Merge neighbours of equal height to keep the skyline short.
+  for (int i = 0; i + 1 < page->num_nodes; ) {
+    if (page->nodes[i].y == page->nodes[i + 1].y) {
+      page->nodes[i].w += page->nodes[i + 1].w;
+      SDL_memmove(&page->nodes[i + 1], &page->nodes[i + 2], (page->num_nodes - i - 2) * sizeof(SkylineNode));
+      page->num_nodes--;
+    } else {
+      ++i;
+    }
+  }
+
+  *out_x = x;
+  *out_y = best_y;
+  return true;
+}
+
+static AtlasPage *atlas_new_page(Atlas *atlas) {
+  if (atlas->num_pages >= ATLAS_MAX_PAGES) return NULL;
+
+  AtlasPage *page = &atlas->pages[atlas->num_pages];
+  page->pixels = SDL_calloc((size_t)ATLAS_PAGE_SIZE * ATLAS_PAGE_SIZE, 4);
+  if (!page->pixels) return NULL;
+
+  skyline_init(page, ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE);
+  atlas->num_pages++;
+  return page;
+}
+
+// Copies the pixels into the first page with room. out_page/out_rect describe
+// the placement; the texture only becomes valid after atlas_upload().
+b8 atlas_add(Atlas *atlas, const u8 *pixels, int width, int height, int pitch, int *out_page, SDL_FRect *out_rect) {
+  int padded_w = width  + 2*ATLAS_PADDING;
+  int padded_h = height + 2*ATLAS_PADDING;
+  if (padded_w > ATLAS_PAGE_SIZE || padded_h > ATLAS_PAGE_SIZE) return false;
+
+  int x, y;
+  AtlasPage *page = NULL;
+  for (int i = 0; i < atlas->num_pages; ++i) {
+    if (atlas->pages[i].pixels && skyline_insert(&atlas->pages[i], padded_w, padded_h, &x, &y)) {
+      page = &atlas->pages[i];
+      break;
+    }
+  }
+
+  if (!page) {
+    page = atlas_new_page(atlas);
+    if (!page || !skyline_insert(page, padded_w, padded_h, &x, &y)) return false;
+  }
+
+  x += ATLAS_PADDING;
+  y += ATLAS_PADDING;
+
+  int page_pitch = page->width * 4;
+  for (int row = 0; row < height; ++row)
+    SDL_memcpy(page->pixels + (size_t)(y + row) * page_pitch + x * 4, pixels + (size_t)row * pitch, (size_t)width * 4);
+
+  page->dirty = true;
+  *out_page = (int)(page - atlas->pages);
+  *out_rect = (SDL_FRect){ x, y, width, height };
+  return true;
+}
+
+// Dry run of atlas_add() for every rect with w > 0, in order, on copies of
+// the skylines. Space handed out is never given back, so a sheet whose
+// frames do not all fit must not place any of them.
+b8 atlas_fits(Atlas *atlas, const SDL_Rect *rects, int count) {
+  AtlasPage trial[ATLAS_MAX_PAGES];
+  b8 open[ATLAS_MAX_PAGES];
+  int num_pages = atlas->num_pages;
+  for (int i = 0; i < num_pages; ++i) {
+    trial[i] = atlas->pages[i];
+    open[i] = atlas->pages[i].pixels != NULL;
+  }
+
+  for (int r = 0; r < count; ++r) {
+    if (rects[r].w <= 0) continue;
+    int padded_w = rects[r].w + 2*ATLAS_PADDING;
+    int padded_h = rects[r].h + 2*ATLAS_PADDING;
+    if (padded_w > ATLAS_PAGE_SIZE || padded_h > ATLAS_PAGE_SIZE) return false;
+
+    int x, y;
+    b8 placed = false;
+    for (int i = 0; i < num_pages && !placed; ++i)
+      placed = open[i] && skyline_insert(&trial[i], padded_w, padded_h, &x, &y);
+    if (placed) continue;
+
+    if (num_pages >= ATLAS_MAX_PAGES) return false;
+    skyline_init(&trial[num_pages], ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE);
+    open[num_pages] = true;
+    if (!skyline_insert(&trial[num_pages++], padded_w, padded_h, &x, &y)) return false;
+  }
+  return true;
+}
+
+// Uploads every page that changed since the last call. Pages stay open for
+// more sprites until atlas_seal() drops their staging memory.
+void atlas_upload(Atlas *atlas, SDL_Renderer *renderer, ResourceRegistry *resources) {
+  for (int i = 0; i < atlas->num_pages; ++i) {
+    AtlasPage *page = &atlas->pages[i];
+    if (!page->dirty) continue;
+
+    if (!page->texture) {
+      page->texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STATIC, page->width, page->height);
+      if (!page->texture) {
+        SDL_Log("Atlas page %d could not be created: %s", i, SDL_GetError());
+        continue;
+      }
+      SDL_SetTextureBlendMode(page->texture, SDL_BLENDMODE_BLEND_PREMULTIPLIED);
+      char name[RESOURCE_NAME_SIZE];
+      SDL_snprintf(name, sizeof(name), "atlas page %d", i);
+      resources_track_texture(resources, page->texture, name, RESOURCE_ATLAS_PAGE);
+    }
+
+    SDL_UpdateTexture(page->texture, NULL, page->pixels, page->width * 4);
+    soft_texture_attach(page->texture, page->pixels, page->width * 4, SDL_PIXELFORMAT_RGBA32, ALPHA_BLENDED);
+    page->dirty = false;
+  }
+}
+
+void atlas_seal(Atlas *atlas) {
+  for (int i = 0; i < atlas->num_pages; ++i) {
+    SDL_free(atlas->pages[i].pixels);
+    atlas->pages[i].pixels = NULL;
+  }
+}
+
+void atlas_destroy(Atlas *atlas, ResourceRegistry *resources) {
+  atlas_seal(atlas);
+  for (int i = 0; i < atlas->num_pages; ++i)
+    resources_release(resources, atlas->pages[i].texture, RESOURCE_ATLAS_PAGE);
+  SDL_zerop(atlas);
+}
@@ -0,0 +1,115 @@
+// Offline asset baker: decodes every PNG passed on the command line into raw
+// RGBA32 and writes them into a single pack (see asset_pack_format.h), so the
+// game never has to inflate PNGs at startup.
+//
+//   bake <out.pack> <in1.png> [in2.png ...]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include "asset_pack_format.h"
+
+static const char *base_name(const char *path) {
+  const char *name = path;
+  for (const char *c = path; *c; ++c)
+    if (*c == '/' || *c == '\\') name = c + 1;
+  return name;
+}
+
+static uint64_t align_up(uint64_t value, uint64_t alignment) {
+  return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static int write_padding(FILE *file, uint64_t count) {
+  static const char zeros[ASSET_PACK_ALIGNMENT] = {0};
+  return fwrite(zeros, 1, count, file) == count;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    fprintf(stderr, "usage: %s <out.pack> <in.png>...\n", argv[0]);
+    return 1;
+  }
+
+  const char *out_path = argv[1];
+  uint32_t entry_count = (uint32_t)(argc - 2);
+
+  AssetPackEntry *entries = calloc(entry_count, sizeof(AssetPackEntry));
+  if (!entries) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+
+  FILE *out = fopen(out_path, "wb");
+  if (!out) {
+    fprintf(stderr, "could not open %s for writing\n", out_path);
+    return 1;
+  }
+
+  // Header and index are written last, once all offsets are known.
+  uint64_t offset = align_up(sizeof(AssetPackHeader) + entry_count * sizeof(AssetPackEntry), ASSET_PACK_ALIGNMENT);
+  if (fseek(out, (long)offset, SEEK_SET) != 0) {
+    fprintf(stderr, "seek failed in %s\n", out_path);
+    return 1;
+  }
+
+  for (uint32_t i = 0; i < entry_count; ++i) {
+    const char *in_path = argv[i + 2];
+    const char *name = base_name(in_path);
+    if (strlen(name) >= ASSET_PACK_NAME_SIZE) {
+      fprintf(stderr, "%s: name longer than %d characters\n", in_path, ASSET_PACK_NAME_SIZE - 1);
+      return 1;
+    }
+
+    int width, height, channels;
+    unsigned char *pixels = stbi_load(in_path, &width, &height, &channels, 4);
+    if (!pixels) {
+      fprintf(stderr, "%s: %s\n", in_path, stbi_failure_reason());
+      return 1;
+    }
+
+    AssetPackEntry *entry = &entries[i];
+    strcpy(entry->name, name);
+    entry->width  = (uint32_t)width;
+    entry->height = (uint32_t)height;
+    entry->pitch  = (uint32_t)width * 4;
+    entry->format = ASSET_PACK_RGBA32;
+    entry->offset = offset;
+    entry->size   = (uint64_t)entry->pitch * entry->height;
+
+    uint64_t padded = align_up(entry->size, ASSET_PACK_ALIGNMENT);
+    if (fwrite(pixels, 1, entry->size, out) != entry->size || !write_padding(out, padded - entry->size)) {
+      fprintf(stderr, "write failed for %s\n", out_path);
+      return 1;
+    }
+    stbi_image_free(pixels);
+
+    printf("  %-40s %5ux%-5u %8.2f MB\n", name, entry->width, entry->height, entry->size / (1024.0 * 1024.0));
+    offset += padded;
+  }
+
+  AssetPackHeader header = {
+    .magic       = ASSET_PACK_MAGIC,
+    .version     = ASSET_PACK_VERSION,
+    .entry_count = entry_count,
+    .header_size = sizeof(AssetPackHeader),
+    .file_size   = offset,
+  };
+
+  if (fseek(out, 0, SEEK_SET) != 0
+      || fwrite(&header, sizeof(header), 1, out) != 1
+      || fwrite(entries, sizeof(AssetPackEntry), entry_count, out) != entry_count) {
+    fprintf(stderr, "could not write index to %s\n", out_path);
+    return 1;
+  }
+
+  fclose(out);
+  free(entries);
+
+  printf("baked %u assets into %s (%.2f MB)\n", entry_count, out_path, offset / (1024.0 * 1024.0));
+  return 0;
+}
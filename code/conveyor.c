@@ -0,0 +1,188 @@
+// Conveyor belts: the interior, static and front belt textures, a row of
+// spinning wheels and two strips of dots that scroll in opposite directions.
+// Everything a frame needs that does not move is worked out once in
+// conveyor_set_sprites(): the wheel's corners around its center, the dot's
+// trimmed rect and the UVs of both. A frame then costs one sin/cos for all
+// wheels and an add per dot, and every quad goes into the sprite batch,
+// where all wheels and all dots of all belts end up in one SDL_RenderGeometry
+// call per texture run. More belts cost vertices, not draw calls.
+//
+// SDL 3.2 has no texture address modes and the dot lives in an atlas page,
+// so a strip is a row of quads rather than one quad with wrapping UVs.
+
+#define CONVEYOR_MAX_WHEELS 16
+
+typedef struct {
+  v2 origin;          // offset of the whole belt, the textures are drawn at it
+  f32 speed;          // pixels per second, the top strip (and what lies on it) moves left
+  f32 wheel_spin;     // degrees per second, negative turns counterclockwise
+  f32 dots_x;         // where the strips start
+  f32 dots_width;     // how far they reach
+  f32 dot_spacing;
+  f32 top_y;          // strip center lines
+  f32 bottom_y;
+  f32 wheel_y;        // wheel center line
+  int num_wheels;
+  f32 wheel_xs[CONVEYOR_MAX_WHEELS];
+} ConveyorLayout;
+
+// The belt in the room, as drawn before there was a conveyor component.
+static const ConveyorLayout conveyor_default_layout = {
+  .speed = 300,
+  .wheel_spin = -290,
+  .dots_x = 0,
+  .dots_width = 1600,
+  .dot_spacing = 100,
+  .top_y = 944,
+  .bottom_y = 1032,
+  .wheel_y = 990,
+  .num_wheels = 8,
+  .wheel_xs = { 98, 300, 490, 664, 827, 1026, 1219, 1432 },
+};
+
+// Ready made geometry of a sprite around its center.
+typedef struct {
+  SDL_Texture *texture;
+  SDL_FPoint corners[4]; // relative to the center, clockwise from top left
+  SDL_FPoint uvs[4];
+} ConveyorQuad;
+
+// What moves. Kept apart so a simulation thread can hand it to drawing.
+typedef struct {
+  f64 angle;        // degrees, kept in [0, 360)
+  f32 shift;        // dot scroll, kept in [0, dot_spacing)
+  f64 prev_angle;   // both at the update before, conveyor_draw() goes in between
+  f32 prev_shift;
+} ConveyorMotion;
+
+typedef struct {
+  ConveyorLayout layout;
+  Sprite interior;  // LAYER_BELT_INTERIOR, behind the props
+  Sprite frame;     // LAYER_BELT_STATIC, in front of them
+  Sprite front;     // LAYER_FRONT_BELT
+  ConveyorQuad wheel;
+  ConveyorQuad dot;
+  ConveyorMotion motion;
+} Conveyor;
+
+void conveyor_init(Conveyor *conveyor, const ConveyorLayout *layout) {
+  SDL_zerop(conveyor);
+  conveyor->layout = *layout;
+  conveyor->layout.num_wheels = SDL_min(layout->num_wheels, CONVEYOR_MAX_WHEELS);
+}
+
+// Drawn at its frame size, centered on (0, 0).
+static ConveyorQuad conveyor_quad(Sprite *sprite) {
+  ConveyorQuad quad = {0};
+  if (!sprite->texture || sprite->src.w <= 0) return quad;
+
+  SDL_FRect frame = { -sprite->frame_dims.x * 0.5f, -sprite->frame_dims.y * 0.5f, sprite->frame_dims.x, sprite->frame_dims.y };
+  SDL_FRect trimmed = sprite_dst_rect(sprite, &frame);
+  SpriteMip mip = sprite_pick_mip(sprite, trimmed.w);
+
+  f32 u0 = mip.src.x / mip.texture->w, u1 = (mip.src.x + mip.src.w) / mip.texture->w;
+  f32 v0 = mip.src.y / mip.texture->h, v1 = (mip.src.y + mip.src.h) / mip.texture->h;
+  quad.texture = mip.texture;
+  quad.corners[0] = (SDL_FPoint){ trimmed.x,             trimmed.y };
+  quad.corners[1] = (SDL_FPoint){ trimmed.x + trimmed.w, trimmed.y };
+  quad.corners[2] = (SDL_FPoint){ trimmed.x + trimmed.w, trimmed.y + trimmed.h };
+  quad.corners[3] = (SDL_FPoint){ trimmed.x,             trimmed.y + trimmed.h };
+  quad.uvs[0] = (SDL_FPoint){ u0, v0 };
+  quad.uvs[1] = (SDL_FPoint){ u1, v0 };
+  quad.uvs[2] = (SDL_FPoint){ u1, v1 };
+  quad.uvs[3] = (SDL_FPoint){ u0, v1 };
+  return quad;
+}
+
+// Sprites without a texture are skipped (or drawn as placeholders), call it
+// again once they are loaded.
+void conveyor_set_sprites(Conveyor *conveyor, Sprite interior, Sprite frame, Sprite front, Sprite wheel, Sprite dot) {
+  conveyor->interior = interior;
+  conveyor->frame = frame;
+  conveyor->front = front;
+  conveyor->wheel = conveyor_quad(&wheel);
+  conveyor->dot = conveyor_quad(&dot);
+}
+
+void conveyor_update(Conveyor *conveyor, f64 dt) {
+  ConveyorLayout *layout = &conveyor->layout;
+  ConveyorMotion *motion = &conveyor->motion;
+  motion->prev_angle = motion->angle;
+  motion->prev_shift = motion->shift;
+  motion->angle = SDL_fmod(motion->angle + layout->wheel_spin * dt, 360.0);
+  if (motion->angle < 0) motion->angle += 360.0;
+  if (layout->dot_spacing > 0) {
+    motion->shift = SDL_fmodf(motion->shift + layout->speed * (f32)dt, layout->dot_spacing);
+    if (motion->shift < 0) motion->shift += layout->dot_spacing;
+  }
+}
+
+static void conveyor_emit(SpriteBatch *batch, u8 layer, f32 depth, ConveyorQuad *quad, f32 x, f32 y, f32 c, f32 s) {
+  SDL_Vertex vertices[4];
+  for (int i = 0; i < 4; ++i) {
+    SDL_FPoint corner = quad->corners[i];
+    vertices[i] = (SDL_Vertex){
+      .position = { x + corner.x*c - corner.y*s, y + corner.x*s + corner.y*c },
+      .color = { 1, 1, 1, 1 },
+      .tex_coord = quad->uvs[i],
+    };
+  }
+  sprite_batch_vertices(batch, layer, depth, quad->texture, vertices);
+}
+
+static void conveyor_draw_texture(SpriteBatch *batch, u8 layer, Sprite *sprite, v2 origin, SDL_FRect placeholder, SDL_Color color) {
+  if (sprite->texture) {
+    sprite_batch_draw(batch, layer, origin.y, sprite, &(SDL_FRect){ origin.x, origin.y, sprite->frame_dims.x, sprite->frame_dims.y });
+  }
+  else {
+    placeholder.x += origin.x;
+    placeholder.y += origin.y;
+    sprite_batch_fill(batch, layer, &placeholder, color);
+  }
+}
+
+// The front belt on its own, see --check-front-belt in main.c.
+void conveyor_draw_front(Conveyor *conveyor, SpriteBatch *batch) {
+  conveyor_draw_texture(batch, LAYER_FRONT_BELT, &conveyor->front, conveyor->layout.origin, (SDL_FRect){0, 890, 1920, 205}, (SDL_Color){0, 0, 255, 255});
+}
+
+// Steps between a and b, the short way around a period.
+static f64 conveyor_lerp_wrapped(f64 a, f64 b, f64 period, f64 t) {
+  f64 delta = b - a;
+  if (delta > period * 0.5) delta -= period;
+  else if (delta < -period * 0.5) delta += period;
+  return a + delta * t;
+}
+
+// Belts further down the screen go in front of the ones above. alpha is how
+// far along from the previous conveyor_update() to the last one, in [0, 1].
+void conveyor_draw(Conveyor *conveyor, SpriteBatch *batch, f32 alpha) {
+  ConveyorLayout *layout = &conveyor->layout;
+  v2 origin = layout->origin;
+  f32 depth = origin.y;
+  ConveyorMotion *motion = &conveyor->motion;
+  f64 angle = conveyor_lerp_wrapped(motion->prev_angle, motion->angle, 360.0, alpha);
+  f32 shift = (f32)conveyor_lerp_wrapped(motion->prev_shift, motion->shift, layout->dot_spacing, alpha);
+
+  conveyor_draw_texture(batch, LAYER_BELT_INTERIOR, &conveyor->interior, origin, (SDL_FRect){0, 890, 400, 400}, (SDL_Color){255, 0, 255, 255});
+  conveyor_draw_texture(batch, LAYER_BELT_STATIC, &conveyor->frame, origin, (SDL_FRect){0, 890, 400, 400}, (SDL_Color){255, 0, 255, 255});
+  conveyor_draw_front(conveyor, batch);
+
+  if (conveyor->wheel.texture) {
+    f32 radians = (f32)(angle * SDL_PI_D / 180.0);
+    f32 c = SDL_cosf(radians), s = SDL_sinf(radians);
+    for (int i = 0; i < layout->num_wheels; ++i)
+      conveyor_emit(batch, LAYER_WHEELS, depth, &conveyor->wheel, origin.x + layout->wheel_xs[i], origin.y + layout->wheel_y, c, s);
+  }
+
+  // The top strip runs left, the bottom one right, one spacing beyond each
+  // end so no gap shows while they scroll.
+  if (conveyor->dot.texture && layout->dot_spacing > 0) {
+    int num_dots = (int)SDL_ceilf(layout->dots_width / layout->dot_spacing) + 1;
+    f32 x = origin.x + layout->dots_x;
+    for (int i = 0; i < num_dots; ++i)
+      conveyor_emit(batch, LAYER_DOTS, depth, &conveyor->dot, x + i*layout->dot_spacing - shift, origin.y + layout->top_y, 1, 0);
+    for (int i = 0; i < num_dots; ++i)
+      conveyor_emit(batch, LAYER_DOTS, depth, &conveyor->dot, x + (i - 1)*layout->dot_spacing + shift, origin.y + layout->bottom_y, 1, 0);
+  }
+}
@@ -0,0 +1,220 @@
+// Dirty rectangle tracking for incremental redraws, meant for the software
+// renderer where every blended pixel costs CPU time.
+//
+// The frame is drawn into a persistent canvas texture instead of the back
+// buffer. Every draw is recorded as a hash of everything that affects its
+// pixels plus its screen bounds. Draws that show up in only one of the last
+// two frames (moved, animated, appeared, gone) mark their bounds dirty.
+// The dirty bounds are merged into a short rect list, and only those rects
+// are redrawn, through clip rects. The canvas is then copied to the screen.
+// The draw tables grow with the frame, see dirty_reserve().
+
+#define DIRTY_MIN_DRAWS 1024
+#define DIRTY_MAX_RECTS 16
+#define DIRTY_MERGE_SLACK (64 * 64) // merge two rects if the union wastes less than this
+#define DIRTY_FULL_RATIO 0.6        // redraw everything once this much is dirty
+
+typedef struct {
+  u64 hash;
+  SDL_Rect bounds;
+} DirtyDraw;
+
+typedef struct {
+  SDL_Texture *canvas; // NULL if the caller keeps the pixels (soft_raster.c)
+  int width;
+  int height;
+
+  DirtyDraw *draws[2]; // [current], [!current] is the last frame
+  int num_draws[2];
+  int max_draws;       // capacity of both
+  int current;
+  int full_redraws; // frames left that have to be redrawn completely
+
+  SDL_Rect *changed; // scratch for dirty_compute(), 2 * max_draws
+  SDL_Rect rects[DIRTY_MAX_RECTS];
+  int num_rects;
+
+  u64 frame_pixels; // redrawn in the last frame
+} DirtyTracker;
+
+// Without a renderer there is no canvas.
+b8 dirty_init(DirtyTracker *dirty, SDL_Renderer *renderer, ResourceRegistry *resources, int width, int height) {
+  SDL_zerop(dirty);
+  dirty->width = width;
+  dirty->height = height;
+  dirty->full_redraws = 1;
+  if (!renderer) return true;
+
+  dirty->canvas = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_XRGB8888, SDL_TEXTUREACCESS_TARGET, width, height);
+  if (!dirty->canvas) {
+    SDL_Log("Dirty rect canvas could not be created: %s", SDL_GetError());
+    return false;
+  }
+  SDL_SetTextureBlendMode(dirty->canvas, SDL_BLENDMODE_NONE);
+  resources_track_texture(resources, dirty->canvas, "dirty rect canvas", RESOURCE_TEXTURE);
+  return true;
+}
+
+// For changes the hashes cannot see: the contents of a texture changed,
+// something was drawn around the tracker, the canvas was lost. Covers this
+// frame and the next one, whose comparison still sees this frame's draws.
+void dirty_invalidate(DirtyTracker *dirty) {
+  dirty->full_redraws = 2;
+}
+
+u64 dirty_hash(const void *data, size_t size, u64 hash) {
+  const u8 *bytes = data;
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+// Room for max_draws draws per frame, keeping what was recorded. Recording
+// grows the tables by itself, reserving keeps that out of the frame.
+b8 dirty_reserve(DirtyTracker *dirty, int max_draws) {
+  if (max_draws <= dirty->max_draws) return true;
+
+  b8 grown = true;
+  for (int i = 0; i < 2; ++i) {
+    DirtyDraw *draws = SDL_realloc(dirty->draws[i], sizeof(DirtyDraw) * max_draws);
+    if (draws) dirty->draws[i] = draws;
+    else grown = false;
+  }
+  SDL_Rect *changed = SDL_realloc(dirty->changed, sizeof(SDL_Rect) * 2 * max_draws);
+  if (changed) dirty->changed = changed;
+  else grown = false;
+  if (!grown) return false;
+
+  dirty->max_draws = max_draws;
+  return true;
+}
+
+void dirty_record(DirtyTracker *dirty, u64 hash, SDL_Rect bounds) {
+  int *count = &dirty->num_draws[dirty->current];
+  if (*count == dirty->max_draws && !dirty_reserve(dirty, SDL_max(dirty->max_draws * 2, DIRTY_MIN_DRAWS))) {
+    dirty_invalidate(dirty);
+    return;
+  }
+  dirty->draws[dirty->current][(*count)++] = (DirtyDraw){ .hash = hash, .bounds = bounds };
+}
+
+static int compare_dirty_draws(const void *a, const void *b) {
+  u64 ha = ((const DirtyDraw *)a)->hash;
+  u64 hb = ((const DirtyDraw *)b)->hash;
+  return ha < hb ? -1 : ha > hb;
+}
+
+static int rect_area(SDL_Rect *rect) {
+  return rect->w * rect->h;
+}
+
+static void dirty_add_rect(DirtyTracker *dirty, SDL_Rect *list, int *count, int capacity, SDL_Rect rect) {
+  SDL_Rect screen = { 0, 0, dirty->width, dirty->height };
+  if (!SDL_GetRectIntersection(&rect, &screen, &rect)) return;
+  if (*count < capacity) list[(*count)++] = rect;
+  else dirty_invalidate(dirty);
+}
+
+// Merges rects that overlap or whose union is barely bigger than the two on
+// their own, then keeps merging the cheapest pair until the list fits.
+static int dirty_merge(SDL_Rect *rects, int count, int max_count) {
+  b8 merged = true;
+  while (merged) {
+    merged = false;
+    for (int i = 0; i < count && !merged; ++i) {
+      for (int j = i + 1; j < count; ++j) {
+        SDL_Rect both;
+        SDL_GetRectUnion(&rects[i], &rects[j], &both);
+        if (rect_area(&both) <= rect_area(&rects[i]) + rect_area(&rects[j]) + DIRTY_MERGE_SLACK) {
+          rects[i] = both;
+          rects[j] = rects[--count];
+          merged = true;
+          break;
+        }
+      }
+    }
+  }
+
+  while (count > max_count) {
+    int best_i = 0, best_j = 1, best_growth = SDL_MAX_SINT32;
+    for (int i = 0; i < count; ++i) {
+      for (int j = i + 1; j < count; ++j) {
+        SDL_Rect both;
+        SDL_GetRectUnion(&rects[i], &rects[j], &both);
+        int growth = rect_area(&both) - rect_area(&rects[i]) - rect_area(&rects[j]);
+        if (growth < best_growth) {
+          best_growth = growth;
+          best_i = i;
+          best_j = j;
+        }
+      }
+    }
+    SDL_GetRectUnion(&rects[best_i], &rects[best_j], &rects[best_i]);
+    rects[best_j] = rects[--count];
+  }
+  return count;
+}
+
+// Compares this frame's draws against the last frame's and fills
+// dirty->rects. Starts the next frame's recording.
+int dirty_compute(DirtyTracker *dirty) {
+  DirtyDraw *current = dirty->draws[dirty->current];
+  DirtyDraw *previous = dirty->draws[!dirty->current];
+  int num_current = dirty->num_draws[dirty->current];
+  int num_previous = dirty->num_draws[!dirty->current];
+
+  SDL_Rect *changed = dirty->changed;
+  int num_changed = 0;
+
+  // previous was sorted when it was the current frame.
+  SDL_qsort(current, num_current, sizeof(DirtyDraw), compare_dirty_draws);
+  if (dirty->full_redraws == 0) {
+    int i = 0, j = 0;
+    while (i < num_current || j < num_previous) {
+      if (j == num_previous || (i < num_current && current[i].hash < previous[j].hash)) {
+        dirty_add_rect(dirty, changed, &num_changed, 2 * dirty->max_draws, current[i++].bounds);
+      } else if (i == num_current || previous[j].hash < current[i].hash) {
+        dirty_add_rect(dirty, changed, &num_changed, 2 * dirty->max_draws, previous[j++].bounds);
+      } else {
+        i++;
+        j++;
+      }
+    }
+  }
+
+  num_changed = dirty_merge(changed, num_changed, DIRTY_MAX_RECTS);
+
+  u64 pixels = 0;
+  for (int i = 0; i < num_changed; ++i) pixels += (u64)rect_area(&changed[i]);
+
+  u64 screen_pixels = (u64)dirty->width * dirty->height;
+  if (dirty->full_redraws > 0 || pixels > screen_pixels * DIRTY_FULL_RATIO) {
+    if (dirty->full_redraws > 0) dirty->full_redraws--;
+    dirty->rects[0] = (SDL_Rect){ 0, 0, dirty->width, dirty->height };
+    dirty->num_rects = 1;
+    pixels = screen_pixels;
+  } else {
+    SDL_memcpy(dirty->rects, changed, sizeof(SDL_Rect) * num_changed);
+    dirty->num_rects = num_changed;
+  }
+
+  dirty->frame_pixels = pixels;
+  dirty->current = !dirty->current;
+  dirty->num_draws[dirty->current] = 0;
+  return dirty->num_rects;
+}
+
+void dirty_report(DirtyTracker *dirty) {
+  SDL_Log("dirty rects: %d rects, %.1f%% of the screen redrawn",
+          dirty->num_rects, 100.0 * dirty->frame_pixels / ((f64)dirty->width * dirty->height));
+}
+
+void dirty_destroy(DirtyTracker *dirty, ResourceRegistry *resources) {
+  if (dirty->canvas) resources_release(resources, dirty->canvas, RESOURCE_TEXTURE);
+  SDL_free(dirty->draws[0]);
+  SDL_free(dirty->draws[1]);
+  SDL_free(dirty->changed);
+  SDL_zerop(dirty);
+}
@@ -0,0 +1,142 @@
+// Dynamic resolution (--dynamic-res): the game keeps drawing in logical
+// 1920x1080 coordinates, but the frame is rendered into only the top left
+// scale * 1920 x scale * 1080 pixels of a logical size target and stretched
+// over the window on present. With the SoftRaster the framebuffer itself is
+// that target (soft_raster_set_scale), so the CPU blends fewer pixels.
+//
+// The scale follows the frame's work time, i.e. everything up to and
+// including SDL_FlushRenderer() but not the wait for vsync, smoothed and
+// compared against the display's frame budget. Above DYNAMIC_RES_DOWN of the
+// budget it drops right away, by as much as the pixel count says it takes to
+// get back to DYNAMIC_RES_AIM. It only goes up one step at a time, once the
+// next step is predicted to stay below DYNAMIC_RES_UP for DYNAMIC_RES_UP_FRAMES
+// frames in a row. The band in between and the cooldown after every change
+// keep it from flipping back and forth.
+
+#define DYNAMIC_RES_STEP       0.05f
+#define DYNAMIC_RES_DOWN       0.90  // fractions of the frame budget
+#define DYNAMIC_RES_AIM        0.80
+#define DYNAMIC_RES_UP         0.75
+#define DYNAMIC_RES_UP_FRAMES  60
+#define DYNAMIC_RES_COOLDOWN   20    // frames after a change, until its cost shows up in the average
+
+typedef struct {
+  SDL_Renderer *renderer;
+  SDL_Texture *target;   // NULL with a SoftRaster
+  SoftRaster *raster;
+  int width;             // logical size
+  int height;
+
+  b8 adaptive;           // false keeps scale where it was set
+  f32 scale;
+  f32 min_scale;
+  f32 max_scale;
+  f64 budget_ms;
+  f64 work_ms;           // smoothed
+  int frames_with_headroom;
+  int cooldown;
+  int num_changes;
+} DynamicRes;
+
+// Pass the raster if the frame is drawn by one, renderer is still needed.
+b8 dynamic_res_init(DynamicRes *res, SDL_Renderer *renderer, SoftRaster *raster, ResourceRegistry *resources, int width, int height) {
+  SDL_zerop(res);
+  res->renderer = renderer;
+  res->raster = raster;
+  res->width = width;
+  res->height = height;
+  res->scale = res->max_scale = 1.f;
+  res->min_scale = 0.5f;
+  res->budget_ms = 1000.0 / 60.0;
+  if (raster) return true;
+
+  res->target = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, width, height);
+  if (!res->target) {
+    SDL_Log("Dynamic resolution target could not be created: %s", SDL_GetError());
+    return false;
+  }
+  SDL_SetTextureBlendMode(res->target, SDL_BLENDMODE_NONE);
+  SDL_SetTextureScaleMode(res->target, SDL_SCALEMODE_LINEAR);
+  resources_track_texture(resources, res->target, "dynamic resolution target", RESOURCE_TEXTURE);
+  return true;
+}
+
+// The refresh rate of the window's display, 60 Hz if it does not say.
+void dynamic_res_set_budget(DynamicRes *res, SDL_Window *window) {
+  const SDL_DisplayMode *mode = SDL_GetCurrentDisplayMode(SDL_GetDisplayForWindow(window));
+  f32 refresh_rate = mode && mode->refresh_rate > 0 ? mode->refresh_rate : 60.f;
+  res->budget_ms = 1000.0 / refresh_rate;
+}
+
+void dynamic_res_set_scale(DynamicRes *res, f32 scale) {
+  res->scale = SDL_clamp(scale, res->min_scale, res->max_scale);
+}
+
+static int dynamic_res_pixels(int size, f32 scale) {
+  return SDL_max((int)(size * scale + 0.5f), 1);
+}
+
+// Instead of setting the window as render target. Called by
+// sprite_batch_begin_frame().
+void dynamic_res_begin_frame(DynamicRes *res) {
+  int w = dynamic_res_pixels(res->width, res->scale), h = dynamic_res_pixels(res->height, res->scale);
+  if (res->raster) {
+    soft_raster_set_scale(res->raster, w, h);
+    return;
+  }
+  //NOTE: The scale belongs to the target, layer caches still draw at 1.
+  SDL_SetRenderTarget(res->renderer, res->target);
+  SDL_SetRenderScale(res->renderer, (f32)w / res->width, (f32)h / res->height);
+}
+
+// Stretches the frame over the window. Called by sprite_batch_end_frame(),
+// the SoftRaster presents by itself.
+void dynamic_res_end_frame(DynamicRes *res) {
+  if (res->raster) return;
+  int w = dynamic_res_pixels(res->width, res->scale), h = dynamic_res_pixels(res->height, res->scale);
+  SDL_SetRenderTarget(res->renderer, NULL);
+  SDL_RenderTexture(res->renderer, res->target, &(SDL_FRect){ 0, 0, (f32)w, (f32)h }, NULL);
+}
+
+// Once per frame with the time spent on it before presenting. Picks the
+// scale of the next frame.
+void dynamic_res_update(DynamicRes *res, f64 work_ms) {
+  if (!res->adaptive) return;
+  res->work_ms = res->work_ms > 0 ? res->work_ms + (work_ms - res->work_ms) * 0.1 : work_ms;
+  if (res->cooldown > 0) {
+    res->cooldown--;
+    return;
+  }
+
+  //NOTE: Work time goes with the pixel count, which goes with scale squared.
+  f32 old_scale = res->scale;
+  if (res->work_ms > res->budget_ms * DYNAMIC_RES_DOWN && res->scale > res->min_scale) {
+    f32 wanted = res->scale * (f32)SDL_sqrt(res->budget_ms * DYNAMIC_RES_AIM / res->work_ms);
+    wanted = SDL_floorf(wanted / DYNAMIC_RES_STEP) * DYNAMIC_RES_STEP;
+    dynamic_res_set_scale(res, SDL_min(wanted, res->scale - DYNAMIC_RES_STEP));
+  }
+  else if (res->scale < res->max_scale) {
+    f32 next = SDL_min(res->scale + DYNAMIC_RES_STEP, res->max_scale);
+    f64 predicted_ms = res->work_ms * (next * next) / (res->scale * res->scale);
+    res->frames_with_headroom = predicted_ms < res->budget_ms * DYNAMIC_RES_UP ? res->frames_with_headroom + 1 : 0;
+    if (res->frames_with_headroom >= DYNAMIC_RES_UP_FRAMES) dynamic_res_set_scale(res, next);
+  }
+  if (res->scale == old_scale) return;
+
+  SDL_Log("dynamic resolution: %.0f%% -> %.0f%% (%.2f of %.2f ms)", old_scale * 100, res->scale * 100, res->work_ms, res->budget_ms);
+  res->work_ms *= (res->scale * res->scale) / (old_scale * old_scale);
+  res->frames_with_headroom = 0;
+  res->cooldown = DYNAMIC_RES_COOLDOWN;
+  res->num_changes++;
+}
+
+void dynamic_res_report(DynamicRes *res) {
+  SDL_Log("dynamic resolution: %dx%d (%.0f%%), %s, work %.2f of %.2f ms, %d changes",
+          dynamic_res_pixels(res->width, res->scale), dynamic_res_pixels(res->height, res->scale), res->scale * 100,
+          res->adaptive ? "adaptive" : "fixed", res->work_ms, res->budget_ms, res->num_changes);
+}
+
+void dynamic_res_destroy(DynamicRes *res, ResourceRegistry *resources) {
+  if (res->target) resources_release(resources, res->target, RESOURCE_TEXTURE);
+  res->target = NULL;
+}
@@ -0,0 +1,221 @@
+// End to end frame times of scripted scenarios (--scenario NAME), meant to run
+// headless with a fixed seed (make bench). Every frame's wall time and draw
+// calls are recorded, the summary goes to a JSON file (--bench-json) and can
+// be checked against the same file from an older build (--bench-baseline).
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#define PSAPI_VERSION 2
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+typedef struct {
+  const char *name;
+  int prop_limit;       // props alive at most
+  f64 spawn_timeout;    // seconds between spawns, < 0 never spawns
+  b8 fill;              // every free spot spawns at once
+  b8 spread;            // spawn anywhere on the belt, not just at its end
+  b8 punch;             // space held down the whole time
+} BenchScenario;
+
+static const BenchScenario bench_scenarios[] = {
+  { .name = "idle",   .prop_limit = 0,    .spawn_timeout = -1 },
+  { .name = "props",  .prop_limit = 20,   .spawn_timeout = 0.1 },
+  { .name = "punch",  .prop_limit = 20,   .spawn_timeout = 0.1, .punch = true },
+  { .name = "stress", .prop_limit = 4000, .spawn_timeout = 0,   .fill = true, .spread = true },
+};
+
+const BenchScenario *bench_scenario_find(const char *name) {
+  for (int i = 0; i < LEN(bench_scenarios); ++i)
+    if (SDL_strcmp(bench_scenarios[i].name, name) == 0) return &bench_scenarios[i];
+  return NULL;
+}
+
+#define FRAME_BENCH_WARMUP 30 // frames left out, loads and first uploads land here
+
+typedef struct {
+  const BenchScenario *scenario;
+  const char *json_path;     // NULL: only logged
+  const char *baseline_path; // NULL: no comparison
+  f64 tolerance;             // slower than baseline by more than this fraction fails
+
+  f64 *frame_ms;
+  int *draw_calls;
+  int num_frames;
+  int capacity;
+  u64 last;
+} FrameBench;
+
+typedef struct {
+  int frames;
+  f64 mean_ms, p50_ms, p95_ms, p99_ms, max_ms;
+  f64 fps;
+  f64 mean_draw_calls;
+  int max_draw_calls;
+  f64 peak_rss_mb;
+} FrameBenchResult;
+
+static u64 peak_rss_bytes(void) {
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS counters;
+  return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? (u64)counters.PeakWorkingSetSize : 0;
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+  return (u64)usage.ru_maxrss;
+#else
+  return (u64)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+// Right before the game loop.
+void frame_bench_begin(FrameBench *bench) {
+  if (bench->tolerance <= 0) bench->tolerance = 0.1;
+  bench->last = SDL_GetPerformanceCounter();
+}
+
+// After SDL_RenderPresent(), once per frame.
+void frame_bench_frame(FrameBench *bench, int draw_calls) {
+  u64 now = SDL_GetPerformanceCounter();
+  f64 ms = (now - bench->last) * 1000.0 / SDL_GetPerformanceFrequency();
+  bench->last = now;
+
+  if (bench->num_frames == bench->capacity) {
+    int capacity = bench->capacity ? bench->capacity * 2 : 1024;
+    f64 *frame_ms = SDL_realloc(bench->frame_ms, capacity * sizeof(f64));
+    if (frame_ms) bench->frame_ms = frame_ms;
+    int *calls = SDL_realloc(bench->draw_calls, capacity * sizeof(int));
+    if (calls) bench->draw_calls = calls;
+    if (!frame_ms || !calls) return;
+    bench->capacity = capacity;
+  }
+  bench->frame_ms[bench->num_frames] = ms;
+  bench->draw_calls[bench->num_frames++] = draw_calls;
+}
+
+static int SDLCALL frame_bench_compare_ms(const void *a, const void *b) {
+  f64 x = *(const f64 *)a, y = *(const f64 *)b;
+  return x < y ? -1 : x > y;
+}
+
+// Nearest rank on sorted times.
+static f64 frame_bench_percentile(f64 *sorted, int count, f64 percent) {
+  int rank = (int)SDL_ceil(percent / 100.0 * count);
+  return sorted[SDL_clamp(rank, 1, count) - 1];
+}
+
+static FrameBenchResult frame_bench_result(FrameBench *bench) {
+  FrameBenchResult result = { .peak_rss_mb = peak_rss_bytes() / (1024.0 * 1024.0) };
+  int first = bench->num_frames > FRAME_BENCH_WARMUP ? FRAME_BENCH_WARMUP : 0;
+  int count = bench->num_frames - first;
+  f64 *sorted = count > 0 ? SDL_malloc(count * sizeof(f64)) : NULL;
+  if (!sorted) return result;
+
+  f64 total_ms = 0;
+  u64 total_calls = 0;
+  for (int i = 0; i < count; ++i) {
+    sorted[i] = bench->frame_ms[first + i];
+    total_ms += sorted[i];
+    total_calls += bench->draw_calls[first + i];
+    result.max_draw_calls = SDL_max(result.max_draw_calls, bench->draw_calls[first + i]);
+  }
+  SDL_qsort(sorted, count, sizeof(f64), frame_bench_compare_ms);
+
+  result.frames = count;
+  result.mean_ms = total_ms / count;
+  result.p50_ms = frame_bench_percentile(sorted, count, 50);
+  result.p95_ms = frame_bench_percentile(sorted, count, 95);
+  result.p99_ms = frame_bench_percentile(sorted, count, 99);
+  result.max_ms = sorted[count - 1];
+  result.fps = total_ms > 0 ? count * 1000.0 / total_ms : 0;
+  result.mean_draw_calls = (f64)total_calls / count;
+  SDL_free(sorted);
+  return result;
+}
+
+static b8 frame_bench_write_json(FrameBench *bench, FrameBenchResult *result, const char *renderer_name) {
+  SDL_IOStream *out = SDL_IOFromFile(bench->json_path, "w");
+  if (!out) {
+    SDL_Log("Could not write %s: %s", bench->json_path, SDL_GetError());
+    return false;
+  }
+  SDL_IOprintf(out,
+               "{\n"
+               "  \"scenario\": \"%s\",\n"
+               "  \"renderer\": \"%s\",\n"
+               "  \"frames\": %d,\n"
+               "  \"frame_ms\": { \"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f },\n"
+               "  \"fps\": %.2f,\n"
+               "  \"draw_calls\": { \"mean\": %.2f, \"max\": %d },\n"
+               "  \"peak_rss_mb\": %.2f\n"
+               "}\n",
+               bench->scenario ? bench->scenario->name : "game", renderer_name ? renderer_name : "unknown",
+               result->frames, result->mean_ms, result->p50_ms, result->p95_ms, result->p99_ms, result->max_ms,
+               result->fps, result->mean_draw_calls, result->max_draw_calls, result->peak_rss_mb);
+  return SDL_CloseIO(out);
+}
+
+// Finds "key": <number> in JSON written by frame_bench_write_json(), the
+// first one wins ("mean" is the frame time). Returns -1 if it is missing.
+static f64 frame_bench_json_number(const char *json, const char *key) {
+  char pattern[64];
+  SDL_snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+  const char *at = SDL_strstr(json, pattern);
+  return at ? SDL_strtod(at + SDL_strlen(pattern), NULL) : -1;
+}
+
+// Logs every number next to the baseline's. Returns false if a frame time
+// got slower than the tolerance allows.
+static b8 frame_bench_compare(FrameBench *bench, FrameBenchResult *result) {
+  char *baseline = SDL_LoadFile(bench->baseline_path, NULL);
+  if (!baseline) {
+    SDL_Log("bench: no baseline at %s, nothing to compare", bench->baseline_path);
+    return true;
+  }
+
+  struct { const char *key; f64 value; b8 timing; } metrics[] = {
+    { .key = "mean", .value = result->mean_ms, .timing = true },
+    { .key = "p50",  .value = result->p50_ms,  .timing = true },
+    { .key = "p95",  .value = result->p95_ms,  .timing = true },
+    { .key = "p99",  .value = result->p99_ms,  .timing = true },
+    { .key = "fps",  .value = result->fps },
+    { .key = "peak_rss_mb", .value = result->peak_rss_mb },
+  };
+  b8 ok = true;
+  SDL_Log("bench: against %s (tolerance %.0f%%)", bench->baseline_path, bench->tolerance * 100);
+  for (int i = 0; i < LEN(metrics); ++i) {
+    f64 old_value = frame_bench_json_number(baseline, metrics[i].key);
+    if (old_value <= 0) continue;
+    f64 change = (metrics[i].value - old_value) / old_value;
+    b8 regressed = metrics[i].timing && change > bench->tolerance;
+    ok = ok && !regressed;
+    SDL_Log("  %-12s %10.4f -> %10.4f  %+7.2f%%%s", metrics[i].key, old_value, metrics[i].value, change * 100, regressed ? "  REGRESSED" : "");
+  }
+  SDL_free(baseline);
+  return ok;
+}
+
+// After the game loop. Returns false if the run regressed against the baseline.
+b8 frame_bench_finish(FrameBench *bench, const char *renderer_name) {
+  FrameBenchResult result = frame_bench_result(bench);
+  SDL_Log("bench %s: %d frames, mean %.3f p50 %.3f p95 %.3f p99 %.3f max %.3f ms, %.1f fps, %.1f draw calls, %.1f MB peak RSS",
+          bench->scenario ? bench->scenario->name : "game", result.frames, result.mean_ms, result.p50_ms,
+          result.p95_ms, result.p99_ms, result.max_ms, result.fps, result.mean_draw_calls, result.peak_rss_mb);
+
+  b8 ok = true;
+  if (bench->json_path) ok = frame_bench_write_json(bench, &result, renderer_name);
+  if (bench->baseline_path) ok = frame_bench_compare(bench, &result) && ok;
+
+  SDL_free(bench->frame_ms);
+  SDL_free(bench->draw_calls);
+  bench->frame_ms = NULL;
+  bench->draw_calls = NULL;
+  bench->num_frames = bench->capacity = 0;
+  return ok;
+}
@@ -0,0 +1,158 @@
+// Frame pacing for when vsync does not do it. Without vsync (it failed, as
+// on some remote and virtual displays, or --fps asks for a rate) every frame
+// gets a deadline one period after the last one. SDL_DelayPrecise() sleeps
+// until shortly before it and a spin of FRAME_PACER_SPIN_NS covers the rest,
+// which the scheduler's wakeup jitter would otherwise eat. A frame that is
+// more than a period late starts a new schedule instead of rushing to catch
+// up.
+//
+// Whatever vsync does, a window nobody looks at does not need full speed:
+// unfocused it runs at up to 30 Hz, minimized, hidden or occluded at 5 Hz.
+// The mode follows the window events. Frame times, their jitter and the CPU
+// time used are kept per mode, see frame_pacer_report().
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#define FRAME_PACER_SPIN_NS 200000 // 0.2 ms
+
+enum PacerMode {
+  PACER_ACTIVE,
+  PACER_UNFOCUSED,
+  PACER_HIDDEN,
+  PACER_NUM_MODES,
+};
+
+static const char *pacer_mode_names[PACER_NUM_MODES] = { "active", "unfocused", "hidden" };
+
+typedef struct {
+  u64 frames;
+  f64 sum_ms;
+  f64 sum_sq_ms;
+  f64 max_ms;
+  f64 sum_error_ms;  // distance from the period, paced frames only
+  u64 paced_frames;
+  f64 wall_s;        // time spent in the mode, and CPU time of the whole process in it
+  f64 cpu_s;
+} PacerStats;
+
+typedef struct {
+  b8 limit_active;             // pace the active mode too, vsync does not
+  f64 rates[PACER_NUM_MODES];  // frames per second
+  enum PacerMode mode;
+
+  u64 deadline_ns;
+  u64 last_frame_ns;
+  u64 mode_start_ns;
+  f64 mode_start_cpu_s;
+  PacerStats stats[PACER_NUM_MODES];
+} FramePacer;
+
+// User plus system time of the process.
+static f64 process_cpu_seconds(void) {
+#ifdef _WIN32
+  FILETIME creation, exited, kernel, user;
+  if (!GetProcessTimes(GetCurrentProcess(), &creation, &exited, &kernel, &user)) return 0;
+  u64 k = (u64)kernel.dwHighDateTime << 32 | kernel.dwLowDateTime;
+  u64 u = (u64)user.dwHighDateTime << 32 | user.dwLowDateTime;
+  return (k + u) * 1e-7;
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+#endif
+}
+
+// fps 0 uses the refresh rate of the window's display.
+void frame_pacer_init(FramePacer *pacer, SDL_Window *window, b8 limit_active, f64 fps) {
+  SDL_zerop(pacer);
+  if (fps <= 0) {
+    const SDL_DisplayMode *mode = SDL_GetCurrentDisplayMode(SDL_GetDisplayForWindow(window));
+    fps = mode && mode->refresh_rate > 0 ? mode->refresh_rate : 60.0;
+  }
+  pacer->limit_active = limit_active;
+  pacer->rates[PACER_ACTIVE] = fps;
+  pacer->rates[PACER_UNFOCUSED] = SDL_min(fps, 30.0);
+  pacer->rates[PACER_HIDDEN] = 5.0;
+  pacer->mode_start_ns = pacer->last_frame_ns = pacer->deadline_ns = SDL_GetTicksNS();
+  pacer->mode_start_cpu_s = process_cpu_seconds();
+}
+
+// Books the time since the last switch to the current mode.
+static void frame_pacer_close_mode(FramePacer *pacer) {
+  u64 now = SDL_GetTicksNS();
+  f64 cpu_s = process_cpu_seconds();
+  PacerStats *stats = &pacer->stats[pacer->mode];
+  stats->wall_s += (now - pacer->mode_start_ns) * 1e-9;
+  stats->cpu_s += cpu_s - pacer->mode_start_cpu_s;
+  pacer->mode_start_ns = now;
+  pacer->mode_start_cpu_s = cpu_s;
+}
+
+// For every window event, the flags say which mode applies.
+void frame_pacer_window_changed(FramePacer *pacer, SDL_Window *window) {
+  SDL_WindowFlags flags = SDL_GetWindowFlags(window);
+  enum PacerMode mode = PACER_ACTIVE;
+  if (flags & (SDL_WINDOW_MINIMIZED | SDL_WINDOW_HIDDEN | SDL_WINDOW_OCCLUDED)) mode = PACER_HIDDEN;
+  else if (!(flags & SDL_WINDOW_INPUT_FOCUS)) mode = PACER_UNFOCUSED;
+  if (mode == pacer->mode) return;
+
+  frame_pacer_close_mode(pacer);
+  SDL_Log("frame pacer: %s -> %s, %.0f fps", pacer_mode_names[pacer->mode], pacer_mode_names[mode], pacer->rates[mode]);
+  pacer->mode = mode;
+}
+
+// After SDL_RenderPresent(). Waits out the rest of the period if the mode is
+// paced, then counts the frame.
+void frame_pacer_wait(FramePacer *pacer) {
+  b8 paced = pacer->mode != PACER_ACTIVE || pacer->limit_active;
+  u64 period_ns = (u64)(1e9 / pacer->rates[pacer->mode]);
+  u64 now = SDL_GetTicksNS();
+
+  if (paced) {
+    pacer->deadline_ns += period_ns;
+    if (pacer->deadline_ns + period_ns < now || pacer->deadline_ns > now + period_ns) pacer->deadline_ns = now;
+    if (pacer->deadline_ns > now) {
+      PROFILE_BEGIN("pacer wait");
+      u64 remaining = pacer->deadline_ns - now;
+      if (remaining > FRAME_PACER_SPIN_NS) SDL_DelayPrecise(remaining - FRAME_PACER_SPIN_NS);
+      while ((now = SDL_GetTicksNS()) < pacer->deadline_ns) SDL_CPUPauseInstruction();
+      PROFILE_END();
+    }
+  }
+  else {
+    pacer->deadline_ns = now;
+  }
+
+  f64 ms = (now - pacer->last_frame_ns) * 1e-6;
+  pacer->last_frame_ns = now;
+  PacerStats *stats = &pacer->stats[pacer->mode];
+  stats->frames++;
+  stats->sum_ms += ms;
+  stats->sum_sq_ms += ms * ms;
+  stats->max_ms = SDL_max(stats->max_ms, ms);
+  if (paced) {
+    stats->sum_error_ms += SDL_fabs(ms - period_ns * 1e-6);
+    stats->paced_frames++;
+  }
+}
+
+// One line per mode that was used: frame rate, frame time, its standard
+// deviation and mean distance from the target, and CPU use in % of a core.
+void frame_pacer_report(FramePacer *pacer) {
+  frame_pacer_close_mode(pacer);
+  for (int i = 0; i < PACER_NUM_MODES; ++i) {
+    PacerStats *stats = &pacer->stats[i];
+    if (!stats->frames) continue;
+    f64 mean = stats->sum_ms / stats->frames;
+    f64 sd = SDL_sqrt(SDL_max(stats->sum_sq_ms / stats->frames - mean * mean, 0.0));
+    b8 paced = i != PACER_ACTIVE || pacer->limit_active;
+    SDL_Log("frame pacer %-9s: %llu frames in %.1f s, %s %.0f fps, frame %.3f ms (sd %.3f, off target %.3f, max %.2f), CPU %.1f%%",
+            pacer_mode_names[i], (unsigned long long)stats->frames, stats->wall_s, paced ? "paced at" : "not paced, display", pacer->rates[i],
+            mean, sd, stats->paced_frames ? stats->sum_error_ms / stats->paced_frames : 0.0, stats->max_ms,
+            stats->wall_s > 0 ? stats->cpu_s / stats->wall_s * 100 : 0.0);
+  }
+}
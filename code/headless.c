@@ -0,0 +1,186 @@
+// Headless runs (--headless N): no display and no GPU needed. SDL's
+// offscreen video driver (dummy if that is missing) with its software
+// renderer, N frames at a fixed dt, rand() seeded with a fixed seed and every
+// load finished before the frame that asked for it. Two runs with the same
+// flags draw the same pixels, so a rendering change can be checked against
+// the CRC32s of an older build and timed on any machine.
+//
+// With an occluder set (headless_set_occluder), every frame is also checked
+// to show it unchanged wherever it is opaque, i.e. that nothing from a layer
+// below it was drawn on top.
+
+typedef struct {
+  b8 enabled;
+  int num_frames;
+  f64 dt;               // seconds per frame
+  u32 seed;
+  const char *dump_dir; // NULL: no frame dumps, otherwise <dir>/frame_00000.bmp ...
+  const char *crc_path; // NULL: no per frame CRCs, "-" logs them
+
+  SDL_IOStream *crc_out;
+  int frame;
+  u32 run_crc;          // CRC32 over all frames, logged at the end
+  u64 start;
+
+  u8 *occluder_mask;    // 1 where the occluder covers the frame, NULL: no check
+  int occluder_w;
+  int occluder_h;
+  u32 occluder_crc;     // of the occluder's pixels under the mask
+  int num_occluded;     // frames in which something showed over it
+} Headless;
+
+// Parses the headless flags at argv[*i], returns false if it is not one.
+b8 headless_parse_arg(Headless *headless, int argc, char **argv, int *i) {
+  if (SDL_strcmp(argv[*i], "--headless") == 0 && *i + 1 < argc) {
+    headless->enabled = true;
+    headless->num_frames = SDL_atoi(argv[++*i]);
+  }
+  else if (SDL_strcmp(argv[*i], "--dt") == 0 && *i + 1 < argc)
+    headless->dt = SDL_atof(argv[++*i]);
+  else if (SDL_strcmp(argv[*i], "--seed") == 0 && *i + 1 < argc)
+    headless->seed = (u32)SDL_strtoul(argv[++*i], NULL, 10);
+  else if (SDL_strcmp(argv[*i], "--dump-frames") == 0 && *i + 1 < argc)
+    headless->dump_dir = argv[++*i];
+  else if (SDL_strcmp(argv[*i], "--frame-crc") == 0 && *i + 1 < argc)
+    headless->crc_path = argv[++*i];
+  else
+    return false;
+  return true;
+}
+
+// Before SDL_Init() and the first rand().
+void headless_configure(Headless *headless) {
+  if (headless->dt <= 0) headless->dt = 1.0 / 60.0;
+  if (headless->num_frames <= 0) headless->num_frames = 1;
+  if (!headless->enabled) return;
+
+  SDL_SetHint(SDL_HINT_VIDEO_DRIVER, "offscreen,dummy");
+  SDL_SetHint(SDL_HINT_AUDIO_DRIVER, "dummy");
+  SDL_SetHint(SDL_HINT_RENDER_DRIVER, SDL_SOFTWARE_RENDERER);
+  srand(headless->seed);
+}
+
+// Right before the game loop.
+b8 headless_begin(Headless *headless) {
+  if (headless->crc_path && SDL_strcmp(headless->crc_path, "-") != 0) {
+    headless->crc_out = SDL_IOFromFile(headless->crc_path, "w");
+    if (!headless->crc_out) {
+      SDL_Log("Could not open %s: %s", headless->crc_path, SDL_GetError());
+      return false;
+    }
+  }
+  if (headless->dump_dir && !SDL_CreateDirectory(headless->dump_dir)) {
+    SDL_Log("Could not create %s: %s", headless->dump_dir, SDL_GetError());
+    return false;
+  }
+
+  SDL_Log("headless: %d frames, dt %g s, seed %u, video driver %s", headless->num_frames, headless->dt, headless->seed, SDL_GetCurrentVideoDriver());
+  headless->start = SDL_GetPerformanceCounter();
+  return true;
+}
+
+// The window's pixels as ARGB8888 whatever the window uses, so CRCs only
+// change when the pixels do.
+SDL_Surface *headless_read_frame(SDL_Renderer *renderer) {
+  SDL_Surface *read = SDL_RenderReadPixels(renderer, NULL);
+  SDL_Surface *frame = read ? SDL_ConvertSurface(read, SDL_PIXELFORMAT_ARGB8888) : NULL;
+  SDL_DestroySurface(read);
+  return frame;
+}
+
+// CRC32 of the pixels under the occluder mask, row by row.
+static u32 headless_masked_crc(Headless *headless, SDL_Surface *frame) {
+  u32 crc = 0;
+  for (int y = 0; y < frame->h; ++y) {
+    const u32 *row = (const u32 *)((const u8 *)frame->pixels + (size_t)y * frame->pitch);
+    const u8 *mask = headless->occluder_mask + (size_t)y * frame->w;
+    for (int x = 0; x < frame->w; ++x)
+      if (mask[x]) crc = SDL_crc32(crc, &row[x], sizeof(u32));
+  }
+  return crc;
+}
+
+// Takes two frames with only the occluder drawn, once over black and once
+// over white. Where they agree nothing behind it shows through, which makes
+// the mask.
+b8 headless_set_occluder(Headless *headless, SDL_Surface *over_black, SDL_Surface *over_white) {
+  if (!over_black || !over_white || over_black->w != over_white->w || over_black->h != over_white->h) {
+    SDL_Log("headless: occluder could not be read back: %s", SDL_GetError());
+    return false;
+  }
+
+  int w = over_black->w, h = over_black->h;
+  SDL_free(headless->occluder_mask);
+  headless->occluder_mask = SDL_malloc((size_t)w * h);
+  if (!headless->occluder_mask) return false;
+
+  int covered = 0;
+  for (int y = 0; y < h; ++y) {
+    const u32 *black = (const u32 *)((const u8 *)over_black->pixels + (size_t)y * over_black->pitch);
+    const u32 *white = (const u32 *)((const u8 *)over_white->pixels + (size_t)y * over_white->pitch);
+    u8 *mask = headless->occluder_mask + (size_t)y * w;
+    for (int x = 0; x < w; ++x) {
+      mask[x] = black[x] == white[x];
+      covered += mask[x];
+    }
+  }
+  headless->occluder_w = w;
+  headless->occluder_h = h;
+  headless->occluder_crc = headless_masked_crc(headless, over_black);
+  SDL_Log("headless: occluder covers %d pixels, crc %08x", covered, headless->occluder_crc);
+  return true;
+}
+
+// After the frame is drawn, before SDL_RenderPresent(). Returns false once
+// the last frame is done.
+b8 headless_end_frame(Headless *headless, SDL_Renderer *renderer) {
+  if (headless->crc_path || headless->dump_dir || headless->occluder_mask) {
+    SDL_Surface *frame = headless_read_frame(renderer);
+    if (!frame) {
+      SDL_Log("headless: frame %d could not be read back: %s", headless->frame, SDL_GetError());
+      return false;
+    }
+
+    u32 crc = 0;
+    for (int y = 0; y < frame->h; ++y)
+      crc = SDL_crc32(crc, (u8 *)frame->pixels + (size_t)y * frame->pitch, (size_t)frame->w * 4);
+    headless->run_crc = SDL_crc32(headless->run_crc, &crc, sizeof(crc));
+
+    if (headless->crc_out) SDL_IOprintf(headless->crc_out, "%d %08x\n", headless->frame, crc);
+    else if (headless->crc_path) SDL_Log("frame %d crc %08x", headless->frame, crc);
+
+    if (headless->occluder_mask) {
+      u32 occluder_crc = frame->w == headless->occluder_w && frame->h == headless->occluder_h ? headless_masked_crc(headless, frame) : 0;
+      if (occluder_crc != headless->occluder_crc && headless->num_occluded++ == 0)
+        SDL_Log("headless: frame %d shows something over the occluder, crc %08x", headless->frame, occluder_crc);
+    }
+
+    if (headless->dump_dir) {
+      char path[512];
+      SDL_snprintf(path, sizeof(path), "%s/frame_%05d.bmp", headless->dump_dir, headless->frame);
+      if (!SDL_SaveBMP(frame, path)) SDL_Log("headless: could not write %s: %s", path, SDL_GetError());
+    }
+    SDL_DestroySurface(frame);
+  }
+
+  return ++headless->frame < headless->num_frames;
+}
+
+// Returns false if the occluder check failed.
+b8 headless_finish(Headless *headless) {
+  f64 ms = (SDL_GetPerformanceCounter() - headless->start) * 1000.0 / SDL_GetPerformanceFrequency();
+  SDL_Log("headless: %d frames in %.3f ms, %.3f ms per frame", headless->frame, ms, headless->frame ? ms / headless->frame : 0.0);
+  if (headless->crc_path || headless->dump_dir) SDL_Log("headless: run crc %08x", headless->run_crc);
+  if (headless->crc_out) SDL_CloseIO(headless->crc_out);
+  headless->crc_out = NULL;
+
+  if (!headless->occluder_mask) return true;
+  SDL_free(headless->occluder_mask);
+  headless->occluder_mask = NULL;
+  if (headless->num_occluded == 0) {
+    SDL_Log("headless: occluder on top in every frame");
+    return true;
+  }
+  SDL_Log("headless: something showed over the occluder in %d of %d frames", headless->num_occluded, headless->frame);
+  return false;
+}
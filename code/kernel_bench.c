@@ -0,0 +1,91 @@
+// Microbenchmark for the load time pixel kernels, run with --bench-kernels.
+// Every RGBA32 image in the baked pack (the whole res/ set) goes through each
+// premultiply variant the CPU supports. The best of a few runs counts, and
+// every variant has to produce the same bytes as the scalar version.
+
+#define KERNEL_BENCH_RUNS 5
+
+typedef struct {
+  const char *name;
+  PremultiplyRowFn premultiply_row;
+} KernelVariant;
+
+static f64 kernel_bench_premultiply(PremultiplyRowFn premultiply_row, Image *src, Image *dst) {
+  f64 best_ms = 0;
+  for (int run = 0; run < KERNEL_BENCH_RUNS; ++run) {
+    u64 start = SDL_GetPerformanceCounter();
+    for (int y = 0; y < src->height; ++y)
+      premultiply_row(src->pixels + (size_t)y * src->pitch, dst->pixels + (size_t)y * dst->pitch, src->width);
+    f64 ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+    if (run == 0 || ms < best_ms) best_ms = ms;
+  }
+  return best_ms;
+}
+
+b8 kernel_bench_run(AssetPack *pack) {
+  if (!pack->header) {
+    SDL_Log("kernel bench needs the baked pack (make pack)");
+    return false;
+  }
+
+  KernelVariant variants[4];
+  int num_variants = 0;
+  variants[num_variants++] = (KernelVariant){ "scalar", premultiply_row_scalar };
+#ifdef SDL_SSE2_INTRINSICS
+  if (SDL_HasSSE2()) variants[num_variants++] = (KernelVariant){ "sse2", premultiply_row_sse2 };
+#endif
+#ifdef SDL_AVX2_INTRINSICS
+  if (SDL_HasAVX2()) variants[num_variants++] = (KernelVariant){ "avx2", premultiply_row_avx2 };
+#endif
+#ifdef SDL_NEON_INTRINSICS
+  if (SDL_HasNEON()) variants[num_variants++] = (KernelVariant){ "neon", premultiply_row_neon };
+#endif
+
+  f64 total_ms[4] = {0};
+  u64 total_bytes = 0;
+  b8 all_match = true;
+
+  SDL_Log("premultiply, best of %d runs", KERNEL_BENCH_RUNS);
+  for (u32 i = 0; i < pack->header->entry_count; ++i) {
+    AssetPackEntry *entry = &pack->entries[i];
+    if (entry->format != ASSET_PACK_RGBA32) continue;
+
+    Image src = { pack->base + entry->offset, entry->width, entry->height, entry->pitch };
+    Image expected = { NULL, src.width, src.height, src.width * 4 };
+    Image out = expected;
+    expected.pixels = SDL_malloc((size_t)expected.pitch * expected.height);
+    out.pixels = SDL_malloc((size_t)out.pitch * out.height);
+    if (!expected.pixels || !out.pixels) {
+      SDL_free(expected.pixels);
+      SDL_free(out.pixels);
+      return false;
+    }
+
+    char line[256];
+    int len = SDL_snprintf(line, sizeof(line), "  %-32s %5dx%-5d", entry->name, src.width, src.height);
+    for (int v = 0; v < num_variants; ++v) {
+      Image *dst = v == 0 ? &expected : &out;
+      f64 ms = kernel_bench_premultiply(variants[v].premultiply_row, &src, dst);
+      total_ms[v] += ms;
+
+      b8 match = v == 0 || SDL_memcmp(expected.pixels, out.pixels, (size_t)out.pitch * out.height) == 0;
+      all_match = all_match && match;
+      if (len < (int)sizeof(line))
+        len += SDL_snprintf(line + len, sizeof(line) - len, " %s %7.3f ms%s", variants[v].name, ms, match ? "" : " MISMATCH");
+    }
+    SDL_Log("%s", line);
+
+    total_bytes += (u64)src.width * src.height * 4;
+    SDL_free(expected.pixels);
+    SDL_free(out.pixels);
+  }
+
+  for (int v = 0; v < num_variants; ++v) {
+    SDL_Log("  %-6s %8.3f ms total, %7.1f MB/s, %.2fx scalar", variants[v].name, total_ms[v],
+            total_ms[v] > 0 ? total_bytes / (1024.0 * 1024.0) / (total_ms[v] / 1000.0) : 0.0,
+            total_ms[v] > 0 ? total_ms[0] / total_ms[v] : 0.0);
+  }
+
+  if (!all_match) SDL_Log("premultiply: SIMD output differs from scalar");
+  return all_match;
+}
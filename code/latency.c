@@ -0,0 +1,141 @@
+// Input to present latency (--latency). Every input that matters to the
+// game gets a sequence number next to its SDL event timestamp. The frame
+// that first shows its effect says so with latency_frame_shows(), and once
+// that frame's SDL_RenderPresent() returns, the time since the event goes
+// into a histogram. Time on the GPU and in the display after that is not
+// seen, so these are lower bounds of what reaches the screen.
+//
+// Low latency mode (--low-latency) predicts the next vblank from the last
+// present (it returns right after one with vsync) and the display's period,
+// and sleeps until just before it, by the smoothed time from polling input
+// to presenting plus a margin. Input is then polled as late as possible. A
+// missed vblank widens the margin, long runs without one narrow it again.
+
+#define LATENCY_MAX_PENDING  256 // inputs waiting for their frame
+#define LATENCY_BUCKETS      64  // one per millisecond, the last one collects the rest
+
+typedef struct {
+  b8 measure;
+  b8 low_latency;
+
+  u64 input_ns[LATENCY_MAX_PENDING]; // event timestamp, by sequence number
+  u32 next_seq;        // sequence number of the next input, 0 is none
+  u32 presented_seq;   // inputs up to here made it to the screen
+  u32 frame_seq;       // inputs up to here are in the frame being drawn
+
+  u32 histogram[LATENCY_BUCKETS];
+  u32 count;
+  u64 sum_ns;
+  u64 max_ns;
+
+  u64 period_ns;
+  u64 frame_start_ns;  // end of the vblank wait, input is polled after it
+  u64 last_present_ns;
+  f64 work_ns;         // smoothed, frame_start_ns to calling SDL_RenderPresent()
+  f64 margin_ns;
+  int frames_on_time;
+  u32 missed;
+  f64 slept_ns;
+} LatencyTracker;
+
+void latency_init(LatencyTracker *latency, SDL_Window *window) {
+  const SDL_DisplayMode *mode = SDL_GetCurrentDisplayMode(SDL_GetDisplayForWindow(window));
+  f32 refresh_rate = mode && mode->refresh_rate > 0 ? mode->refresh_rate : 60.f;
+  latency->period_ns = (u64)(1e9 / refresh_rate);
+  latency->margin_ns = 1e6;
+  latency->next_seq = 1;
+}
+
+// Top of the frame, before input is polled.
+void latency_wait_for_vblank(LatencyTracker *latency) {
+  u64 now = SDL_GetTicksNS();
+  if (latency->low_latency && latency->last_present_ns) {
+    u64 lead = (u64)(latency->work_ns * 1.25 + latency->margin_ns);
+    u64 wake = latency->last_present_ns + latency->period_ns - SDL_min(lead, latency->period_ns);
+    if (wake > now) {
+      PROFILE_SCOPE("vblank wait") SDL_DelayPrecise(wake - now);
+      latency->slept_ns += (f64)(wake - now);
+      now = SDL_GetTicksNS();
+    }
+  }
+  latency->frame_start_ns = now;
+}
+
+// An input event the game reacts to, timestamp from the SDL event. Returns
+// its sequence number, 0 when not measuring.
+u32 latency_input(LatencyTracker *latency, u64 timestamp_ns) {
+  if (!latency->measure) return 0;
+  u32 seq = latency->next_seq++;
+  latency->input_ns[seq % LATENCY_MAX_PENDING] = timestamp_ns;
+  return seq;
+}
+
+// The frame being drawn shows every input up to seq.
+void latency_frame_shows(LatencyTracker *latency, u32 seq) {
+  if (seq > latency->frame_seq) latency->frame_seq = seq;
+}
+
+// Right around SDL_RenderPresent(), with the ticks before and after it.
+void latency_presented(LatencyTracker *latency, u64 before_ns, u64 after_ns) {
+  for (u32 seq = latency->presented_seq + 1; seq <= latency->frame_seq; ++seq) {
+    //NOTE: Inputs that were lapped in the ring are not counted.
+    if (latency->frame_seq - seq >= LATENCY_MAX_PENDING) continue;
+    u64 input_ns = latency->input_ns[seq % LATENCY_MAX_PENDING];
+    u64 ns = after_ns > input_ns ? after_ns - input_ns : 0;
+    latency->histogram[SDL_min(ns / 1000000, LATENCY_BUCKETS - 1)]++;
+    latency->count++;
+    latency->sum_ns += ns;
+    latency->max_ns = SDL_max(latency->max_ns, ns);
+  }
+  latency->presented_seq = latency->frame_seq;
+
+  f64 work_ns = (f64)(before_ns - latency->frame_start_ns);
+  latency->work_ns = latency->work_ns > 0 ? latency->work_ns + (work_ns - latency->work_ns) * 0.1 : work_ns;
+  if (latency->low_latency && latency->last_present_ns) {
+    if (after_ns - latency->last_present_ns > latency->period_ns * 3 / 2) {
+      latency->missed++;
+      latency->frames_on_time = 0;
+      latency->margin_ns = SDL_min(latency->margin_ns + 0.5e6, latency->period_ns * 0.5);
+    }
+    else if (++latency->frames_on_time >= 120) {
+      latency->frames_on_time = 0;
+      latency->margin_ns = SDL_max(latency->margin_ns - 0.1e6, 0.5e6);
+    }
+  }
+  latency->last_present_ns = after_ns;
+}
+
+// Percentile from the histogram, the upper edge of its bucket.
+static int latency_percentile_ms(LatencyTracker *latency, f64 percent) {
+  u32 rank = (u32)SDL_ceil(percent / 100.0 * latency->count), seen = 0;
+  for (int i = 0; i < LATENCY_BUCKETS; ++i) {
+    seen += latency->histogram[i];
+    if (seen >= rank) return i + 1;
+  }
+  return LATENCY_BUCKETS;
+}
+
+void latency_report(LatencyTracker *latency) {
+  if (latency->low_latency)
+    SDL_Log("low latency: work %.2f ms, margin %.2f ms, %u missed vblanks, %.1f ms slept in total",
+            latency->work_ns / 1e6, latency->margin_ns / 1e6, latency->missed, latency->slept_ns / 1e6);
+  if (!latency->measure) return;
+  if (!latency->count) {
+    SDL_Log("input to present: no inputs yet");
+    return;
+  }
+
+  SDL_Log("input to present: %u inputs, mean %.2f ms, p50 <%d p95 <%d p99 <%d ms, max %.2f ms",
+          latency->count, latency->sum_ns / 1e6 / latency->count, latency_percentile_ms(latency, 50),
+          latency_percentile_ms(latency, 95), latency_percentile_ms(latency, 99), latency->max_ns / 1e6);
+  u32 most = 0;
+  for (int i = 0; i < LATENCY_BUCKETS; ++i) most = SDL_max(most, latency->histogram[i]);
+  for (int i = 0; i < LATENCY_BUCKETS; ++i) {
+    if (!latency->histogram[i]) continue;
+    char bar[41];
+    int length = SDL_max((int)((u64)latency->histogram[i] * 40 / most), 1);
+    SDL_memset(bar, '#', length);
+    bar[length] = 0;
+    SDL_Log("  %2d-%2d%s ms %6u %s", i, i + 1, i == LATENCY_BUCKETS - 1 ? "+" : " ", latency->histogram[i], bar);
+  }
+}
@@ -0,0 +1,118 @@
+// Layer cache: static layers composited once into a render target texture,
+// which is then drawn with a single blit per frame. The cache only knows a
+// key describing its inputs (which background variant, ...). Callers
+// re-render it when layer_cache_valid() says the key changed, and keep
+// drawing the old contents until the new inputs are available.
+//
+// Only layers that are contiguous in draw order can share a cache. Dynamic
+// sprites that sit between static layers go in between separate caches.
+//
+// With a SoftRaster (layer_cache_use_soft_raster) the cache lives in the CPU
+// copy of its texture and layer_cache_draw() rasterizes into it.
+
+typedef struct {
+  SDL_Renderer *renderer;
+  SDL_Texture *target;
+  SDL_Texture *previous_target; // restored by layer_cache_end()
+  SoftRaster *raster;          // NULL renders with the SDL renderer
+  SoftImage *image;            // the target's CPU copy with a SoftRaster
+  Sprite sprite;     // the whole target, ready for sprite_batch_draw()
+
+  u64 key;
+  b8 has_contents;   // something was rendered, key may be outdated
+  b8 valid;          // contents match key
+  u32 num_rebuilds;
+} LayerCache;
+
+b8 layer_cache_init(LayerCache *cache, SDL_Renderer *renderer, ResourceRegistry *resources, const char *name, int width, int height) {
+  SDL_zerop(cache);
+  cache->renderer = renderer;
+  cache->target = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, width, height);
+  if (!cache->target) {
+    SDL_Log("Layer cache %s could not be created: %s", name, SDL_GetError());
+    return false;
+  }
+  resources_track_texture(resources, cache->target, name, RESOURCE_TEXTURE);
+
+  cache->sprite = (Sprite){
+    .texture = cache->target,
+    .src = { 0, 0, width, height },
+    .trim = { 0, 0, width, height },
+    .frame_dims = { .x = width, .y = height },
+    .alpha = ALPHA_BLENDED,
+  };
+  return true;
+}
+
+b8 layer_cache_use_soft_raster(LayerCache *cache, SoftRaster *raster) {
+  cache->image = cache->target ? soft_texture_attach(cache->target, NULL, 0, SDL_PIXELFORMAT_ARGB8888, ALPHA_BLENDED) : NULL;
+  cache->raster = cache->image ? raster : NULL;
+  cache->valid = false;
+  cache->has_contents = false;
+  return cache->raster != NULL;
+}
+
+b8 layer_cache_valid(LayerCache *cache, u64 key) {
+  return cache->valid && cache->key == key;
+}
+
+// Everything drawn with layer_cache_draw() until layer_cache_end() goes into
+// the cache. opaque means the layers cover every pixel, so the cache is drawn
+// without blending. Otherwise its pixels come out premultiplied, like
+// every other texture we blend.
+b8 layer_cache_begin(LayerCache *cache, b8 opaque) {
+  if (cache->raster) {
+    soft_raster_set_target(cache->raster, cache->image);
+    soft_raster_fill(cache->raster, &(SDL_Rect){ 0, 0, cache->image->width, cache->image->height }, 0);
+    cache->image->alpha = cache->sprite.alpha = opaque ? ALPHA_OPAQUE : ALPHA_BLENDED;
+    return true;
+  }
+
+  cache->previous_target = SDL_GetRenderTarget(cache->renderer);
+  if (!cache->target || !SDL_SetRenderTarget(cache->renderer, cache->target)) return false;
+
+  SDL_SetRenderDrawColor(cache->renderer, 0, 0, 0, 0);
+  SDL_RenderClear(cache->renderer);
+
+  cache->sprite.alpha = opaque ? ALPHA_OPAQUE : ALPHA_BLENDED;
+  SDL_SetTextureBlendMode(cache->target, opaque ? SDL_BLENDMODE_NONE : SDL_BLENDMODE_BLEND_PREMULTIPLIED);
+  return true;
+}
+
+void layer_cache_draw(LayerCache *cache, Sprite *sprite, SDL_FRect *dst) {
+  if (!cache->raster) {
+    draw_sprite(cache->renderer, sprite, dst);
+    return;
+  }
+  if (!sprite->texture || sprite->src.w <= 0) return;
+
+  SDL_FRect trimmed = sprite_dst_rect(sprite, dst);
+  SpriteMip mip = sprite_pick_mip(sprite, trimmed.w);
+  soft_raster_blit(cache->raster, mip.texture, &mip.src, &trimmed);
+}
+
+void layer_cache_end(LayerCache *cache, u64 key) {
+  if (cache->raster) soft_raster_set_target(cache->raster, NULL);
+  else SDL_SetRenderTarget(cache->renderer, cache->previous_target);
+  cache->key = key;
+  cache->valid = true;
+  cache->has_contents = true;
+  cache->num_rebuilds++;
+}
+
+// Render targets lose their contents on SDL_EVENT_RENDER_TARGETS_RESET and
+// SDL_EVENT_RENDER_DEVICE_RESET.
+void layer_cache_invalidate(LayerCache *cache) {
+  cache->valid = false;
+  cache->has_contents = false;
+}
+
+// NULL while nothing has been rendered yet.
+Sprite *layer_cache_sprite(LayerCache *cache) {
+  return cache->has_contents ? &cache->sprite : NULL;
+}
+
+void layer_cache_destroy(LayerCache *cache, ResourceRegistry *resources) {
+  if (cache->target) resources_release(resources, cache->target, RESOURCE_TEXTURE);
+  SDL_zerop(cache);
+}
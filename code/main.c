@@ -27,8 +27,8 @@ typedef double f64;
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
-#define MIN(a, b) (a) < (b) ? a : b
-#define MAX(a, b) (a) > (b) ? a : b
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
 
 f64 rand_0_to_1() {
   return (f64)rand() / RAND_MAX;
@@ -62,9 +62,12 @@ typedef struct {
 #define GRAVITY_SPEED 400.0f;
 
 #define make_ani(ani_array, delay) { .frames = ani_array, .num_frames = sizeof(ani_array) / sizeof(ani_array[0]), .duration = delay, .elapsed = 0., .cur_frame = 0 }
-#define LEN(arr) (sizeof(arr) / sizeof(arr[0]))
+#define LEN(arr) ((int)(sizeof(arr) / sizeof(arr[0])))
 
-SDL_Texture* load_tex_from_png(SDL_Renderer *renderer, const char *filename) {
+#include "profiler.c"
+#include "resources.c"
+
+SDL_Texture* load_tex_from_png(SDL_Renderer *renderer, ResourceRegistry *resources, const char *filename) {
   int width, height, channels;
   unsigned char *data = stbi_load(filename, &width, &height, &channels, 4); // 4 = RGBA
   if (!data) {
@@ -82,9 +85,51 @@ SDL_Texture* load_tex_from_png(SDL_Renderer *renderer, const char *filename) {
   SDL_UpdateTexture(texture, NULL, data, width * 4);
   stbi_image_free(data);
 
-  return texture;
+  return resources_track_texture(resources, texture, filename, RESOURCE_TEXTURE);
 }
 
+#include "asset_pack.c"
+#ifdef EMBEDDED_ASSETS
+extern const u8 embedded_pack[];     // code/embedded_pack.S
+extern const u8 embedded_pack_end[];
+#endif
+
+#include "sprite.c"
+#include "dirty_rects.c"
+#include "raster_kernels.c"
+#include "soft_raster.c"
+#include "dynamic_res.c"
+#include "sprite_batch.c"
+#include "layer_cache.c"
+
+//NOTE: Back to front. The order of the draw calls in the main loop does not
+// matter, only these layers do.
+enum RenderLayer {
+  LAYER_BACKGROUND,
+  LAYER_CAT_TAIL,
+  LAYER_CAT_BODY,
+  LAYER_CAT_FACE,
+  LAYER_BELT_INTERIOR,
+  LAYER_PROPS,
+  LAYER_BELT_STATIC,
+  LAYER_WHEELS,
+  LAYER_DOTS,
+  LAYER_FRONT_BELT,
+  LAYER_BOSS,
+};
+#include "pixel_kernels.c"
+#include "kernel_bench.c"
+#include "atlas.c"
+#include "asset_loader.c"
+#include "residency.c"
+#include "conveyor.c"
+#include "raster_bench.c"
+#include "headless.c"
+#include "frame_bench.c"
+#include "triple_buffer.c"
+#include "latency.c"
+#include "frame_pacer.c"
+
 SDL_FRect frame_at(v2 grid_coord, v2 spr_dims) {
   return (SDL_FRect) { spr_dims.x*grid_coord.x,  spr_dims.y*grid_coord.y, spr_dims.x, spr_dims.y};
 }
@@ -106,10 +151,11 @@ enum PROP_STATE {
 typedef struct {
   int hp;
   enum PROP_STATE broken;
-  SDL_Texture* texture;
+  SpriteSheet *sheet;
   v2 frame_dims;
   v2 display_dims;
   v2 position;
+  v2 prev_position; // at the step before, drawing goes in between
   bool alive;
 } Prop;
 
@@ -152,16 +198,18 @@ typedef struct {
 
   b8 loop;
 
-  SDL_Texture *spr_tex;
+  SpriteSheet sheet;
 } AnimatedObject;
 
 // returns true if animation ended?
+//NOTE: Advances as many frames as elapsed_delta_sec covers and keeps the
+// rest, so short frames are not dropped when a step is longer than they are.
 b8 update_animation(Animation *animation, f64 elapsed_delta_sec) {
   animation->elapsed += elapsed_delta_sec;
 
-  if(animation->elapsed > animation->duration) {
+  while(animation->duration > 0 && animation->elapsed >= animation->duration) {
     animation->cur_frame++;
-    animation->elapsed = 0.f;
+    animation->elapsed -= animation->duration;
     if(animation->cur_frame >= animation->num_frames) {
       animation->cur_frame = 0;
       return true;
@@ -192,10 +240,10 @@ void display_animation(v2 sndplr_pos, Animation *animation, v2 spr_dims, SDL_Tex
   SDL_RenderTexture(renderer, spr_tex, &srcRect, &spr_rect);
 }
 
-void display_animated_object(AnimatedObject* ani_obj, SDL_Renderer *renderer) {
-  Animation *animation = &ani_obj->animations[ani_obj->cur_animation];
-  v2 frame_coord_on_grid = animation->frames[animation->cur_frame];
-  SDL_FRect srcRect = frame_at(frame_coord_on_grid, ani_obj->frame_dims);
+//NOTE: The frame comes from a FrameSnapshot, the animation state belongs to
+// the simulation.
+void display_animated_object(AnimatedObject* ani_obj, v2 frame_coord_on_grid, SpriteBatch *batch, enum RenderLayer layer) {
+  Sprite *frame = sheet_frame(&ani_obj->sheet, frame_coord_on_grid);
   v2 center = {ani_obj->display_dims.x/2, ani_obj->display_dims.y/2 };
 
   SDL_FRect dst_spr_rect = {
@@ -205,7 +253,7 @@ void display_animated_object(AnimatedObject* ani_obj, SDL_Renderer *renderer) {
     .h = ani_obj->display_dims.y
   };
 
-  SDL_RenderTexture(renderer, ani_obj->spr_tex, &srcRect, &dst_spr_rect);
+  sprite_batch_draw(batch, layer, 0, frame, &dst_spr_rect);
 
 }
 
@@ -216,17 +264,19 @@ typedef struct {
   u32 wave_len;
 } SoundPlayer;
 
-void sndplr_destroy(SoundPlayer *player) {
-  SDL_free(player->wave_buf);
+void sndplr_destroy(SoundPlayer *player, ResourceRegistry *resources) {
+  SDL_DestroyAudioStream(player->audio_stream);
+  resources_release(resources, player->wave_buf, RESOURCE_AUDIO);
   SDL_zerop(player);
 }
 
-bool sndplr_loadwav(SoundPlayer *player, char *filename) {
+bool sndplr_loadwav(SoundPlayer *player, ResourceRegistry *resources, char *filename) {
   SDL_AudioSpec wave_spec = {0, 0, 0};
   if (!SDL_LoadWAV(filename, &wave_spec, &player->wave_buf, &player->wave_len)) {
     SDL_Log("Audio datei NICHT geladen, weil: %s", SDL_GetError());
     return false;
   }
+  resources_track_audio(resources, player->wave_buf, player->wave_len, filename);
 
   player->audio_stream = SDL_OpenAudioDeviceStream(SDL_AUDIO_DEVICE_DEFAULT_PLAYBACK, &wave_spec, NULL, NULL);
   if (player->audio_stream == NULL) {
@@ -319,9 +369,18 @@ enum PropLvl {
   LARGE
 };
 
+#define MAX_PROPS 4096
+#define MAX_FRAME_QUADS (MAX_PROPS + 256) // every prop plus the rest of the scene
+
+//NOTE: Game state only changes in steps of SIM_DT, the frame rate does not
+// matter to it. SIM_MAX_STEPS is the most a single frame catches up on.
+#define SIM_HZ        120
+#define SIM_DT        (1.0 / SIM_HZ)
+#define SIM_MAX_STEPS 12
+
 #define ENM_RAND_RNG(startenm, endenm) (assert((startenm) < (endenm)), (startenm) + (rand() % ((endenm) - (startenm) +1)))
 // lvl from 0 to 2
-Prop create_prop_rand(enum PropLvl lvl, SDL_Texture** prop_texture_list) {
+Prop create_prop_rand(enum PropLvl lvl, SpriteSheet* prop_sheet_list) {
   enum PropType type;
   if (lvl == SMALL) {
     type = ENM_RAND_RNG(DUCK, FLOWER);
@@ -345,32 +404,37 @@ Prop create_prop_rand(enum PropLvl lvl, SDL_Texture** prop_texture_list) {
   }
 
   v2 start_pos = {1900, 940};
-  SDL_Texture* spr_tex = prop_texture_list[type];
+  SpriteSheet *sheet = &prop_sheet_list[type];
   Prop prop = {
     .hp = lvl + 1,
     .broken = WHOLE,//(rand() % 2) == 0,
-    .texture = spr_tex,
-    .frame_dims = {spr_tex->w / 2, spr_tex->h},
-    .display_dims = {spr_tex->w/2 * scale , spr_tex->h *  scale},
+    .sheet = sheet,
+    .frame_dims = sheet->frame_dims,
+    .display_dims = {sheet->frame_dims.x * scale , sheet->frame_dims.y *  scale},
     .position = start_pos,
+    .prev_position = start_pos,
     .alive = true
   };
 
   return prop;
 }
 
-void display_prop(Prop *prop, SDL_Renderer *renderer) {
-  SDL_FRect srcRect = frame_at((v2) {prop->broken == BROKEN ? 1. : 0.}, prop->frame_dims);
-
+void display_prop(Prop *prop, SpriteBatch *batch, f32 alpha) {
+  Sprite *frame = sheet_frame(prop->sheet, (v2) {prop->broken == BROKEN ? 1. : 0.});
+  v2 position = {
+    .x = prop->prev_position.x + (prop->position.x - prop->prev_position.x) * alpha,
+    .y = prop->prev_position.y + (prop->position.y - prop->prev_position.y) * alpha,
+  };
 
   SDL_FRect spr_rect = (SDL_FRect) {
-    .x = prop->position.x - prop->display_dims.x/2,
-    .y = prop->position.y - prop->display_dims.y,
+    .x = position.x - prop->display_dims.x/2,
+    .y = position.y - prop->display_dims.y,
     .w = prop->display_dims.x,
     .h = prop->display_dims.y
   };
 
-  SDL_RenderTexture(renderer, prop->texture, &srcRect, &spr_rect);
+  //NOTE: Props further down the belt (larger y) go in front.
+  sprite_batch_draw(batch, LAYER_PROPS, position.y, frame, &spr_rect);
 }
 
 char *make_path(char *buffer, s32 buffer_size, char *string_a, char *string_b)
@@ -404,20 +468,332 @@ void animation_obj_start(AnimatedObject *ani_obj, CatAnimation set_animation) {
   ani_obj->animations[ani_obj->cur_animation].elapsed = 0;
 }
 
+//NOTE: Everything the game simulates. One thread owns it (see
+// simulation_thread), drawing only ever sees the FrameSnapshots it publishes.
+typedef struct {
+  // Set up before the simulation starts, read only afterwards.
+  SpriteSheet *prop_sheets;
+  const BenchScenario *scenario;
+
+  AnimatedObject cat_tail;
+  AnimatedObject cat_body;
+  AnimatedObject cat_face;
+  Conveyor conveyor;
+  Prop props[MAX_PROPS];
+  int prop_spawn_limit;
+  int num_props_alive;
+  f64 spawn_timeout_min;
+  f64 spawn_timeout_max;
+  f64 cur_spawn_timeout;
+  f64 spawn_elapsed;
+  f64 accumulator;
+  f64 dropped_sec;
+  u64 steps;
+  u32 input_seq;            // latency sequence number of the last press a step reacted to
+
+  // Written by the main thread.
+  SDL_AtomicInt punch_held;
+  SDL_AtomicInt punches;    // SPACE presses the simulation has not seen
+  SDL_AtomicInt punch_input; // latency sequence number of the newest press
+  SDL_AtomicInt quit;
+
+  TripleBuffer snapshots;
+  SDL_Thread *thread;       // NULL: the main thread calls simulation_advance()
+} Simulation;
+
+//NOTE: What a frame needs to draw the simulation. Never changed after it is
+// published, the main thread reads it while the next one is simulated.
+typedef struct {
+  u64 steps;
+  u64 time;              // performance counter when the last step was due
+  f64 dropped_sec;
+  u32 input_seq;         // shows the inputs up to this one, see latency_frame_shows()
+  v2 cat_frames[3];      // sheet coordinates of tail, body and face
+  int face_animation;
+  ConveyorMotion conveyor;
+  int num_props;
+  Prop props[MAX_PROPS]; // the alive ones
+} FrameSnapshot;
+
+static FrameSnapshot frame_snapshots[3];
+
+static v2 animated_object_frame(AnimatedObject *ani_obj) {
+  Animation *animation = &ani_obj->animations[ani_obj->cur_animation];
+  return animation->frames[animation->cur_frame];
+}
+
+static void simulation_publish(Simulation *sim, u64 now) {
+  FrameSnapshot *snapshot = triple_buffer_write_slot(&sim->snapshots);
+  snapshot->steps = sim->steps;
+  snapshot->time = now - (u64)(sim->accumulator * SDL_GetPerformanceFrequency());
+  snapshot->dropped_sec = sim->dropped_sec;
+  snapshot->input_seq = sim->input_seq;
+  snapshot->cat_frames[0] = animated_object_frame(&sim->cat_tail);
+  snapshot->cat_frames[1] = animated_object_frame(&sim->cat_body);
+  snapshot->cat_frames[2] = animated_object_frame(&sim->cat_face);
+  snapshot->face_animation = sim->cat_face.cur_animation;
+  snapshot->conveyor = sim->conveyor.motion;
+  snapshot->num_props = 0;
+  for (int i = 0; i < sim->prop_spawn_limit; ++i)
+    if (sim->props[i].alive) snapshot->props[snapshot->num_props++] = sim->props[i];
+  triple_buffer_publish(&sim->snapshots);
+}
+
+// The objects are copies, their animations and sheets are not. Publishes the
+// starting state, so there is a snapshot before the first step.
+void simulation_init(Simulation *sim, AnimatedObject *cat_tail, AnimatedObject *cat_body, AnimatedObject *cat_face,
+                     Conveyor *conveyor, SpriteSheet *prop_sheets, const BenchScenario *scenario) {
+  SDL_zerop(sim);
+  sim->prop_sheets = prop_sheets;
+  sim->scenario = scenario;
+  sim->cat_tail = *cat_tail;
+  sim->cat_body = *cat_body;
+  sim->cat_face = *cat_face;
+  sim->conveyor = *conveyor;
+
+  // spawn settings
+  //NOTE: The game keeps 20 props at most, the stress scenario thousands.
+  sim->prop_spawn_limit = 20;
+  sim->spawn_timeout_min = 1; // sec
+  sim->spawn_timeout_max = 3; // sec
+  if (scenario) {
+    sim->prop_spawn_limit = SDL_min(scenario->prop_limit, MAX_PROPS);
+    sim->spawn_timeout_min = sim->spawn_timeout_max = scenario->spawn_timeout;
+  }
+
+  triple_buffer_init(&sim->snapshots, &frame_snapshots[0], &frame_snapshots[1], &frame_snapshots[2]);
+  simulation_publish(sim, SDL_GetPerformanceCounter());
+}
+
+static void simulation_step(Simulation *sim) {
+  const BenchScenario *scenario = sim->scenario;
+  sim->steps++;
+
+  //NOTE: punch_input is set before punches is counted up, so it is at least
+  // as new as the presses taken here.
+  b8 pressed = SDL_SetAtomicInt(&sim->punches, 0) > 0;
+  if (pressed) sim->input_seq = (u32)SDL_GetAtomicInt(&sim->punch_input);
+  if (pressed || SDL_GetAtomicInt(&sim->punch_held))
+    animation_obj_start(&sim->cat_body, PUNCH);
+
+  // spawn behavior
+  sim->spawn_elapsed += SIM_DT;
+  if (sim->spawn_elapsed > sim->cur_spawn_timeout && sim->spawn_timeout_max >= 0) {
+    sim->spawn_elapsed = 0.;
+    sim->cur_spawn_timeout = sim->spawn_timeout_min + (sim->spawn_timeout_max - sim->spawn_timeout_min)*rand_0_to_1();
+    //NOTE: One prop per timeout, into the last free spot. The stress
+    // scenario fills every free spot at once.
+    int num_spawns = scenario && scenario->fill ? sim->prop_spawn_limit : 1;
+    for (int i = sim->prop_spawn_limit - 1; i >= 0 && num_spawns > 0 && sim->num_props_alive < sim->prop_spawn_limit; --i) {
+      Prop *prop = &sim->props[i];
+      if (prop->alive) continue;
+
+      *prop = create_prop_rand(rand() % 3, sim->prop_sheets);
+      if (scenario && scenario->spread) prop->position.x = prop->prev_position.x = 1900 * rand_0_to_1();
+      sim->num_props_alive++;
+      num_spawns--;
+    }
+  }
+
+  AnimatedObject *cat_body = &sim->cat_body;
+  if (sheet_is_loaded(&sim->cat_tail.sheet)) update_animated_object(&sim->cat_tail, SIM_DT);
+  if (sheet_is_loaded(&cat_body->sheet)) update_animated_object(cat_body, SIM_DT);
+  if (sheet_is_loaded(&sim->cat_face.sheet)) update_animated_object(&sim->cat_face, SIM_DT);
+
+  conveyor_update(&sim->conveyor, SIM_DT);
+
+  for (int i = 0; i < sim->prop_spawn_limit; ++i) {
+    Prop *prop = &sim->props[i];
+    if (!prop->alive) continue;
+
+    prop->prev_position = prop->position;
+    prop->position.x -= SIM_DT * sim->conveyor.layout.speed;
+    if (prop->position.x < -prop->sheet->image_dims.x) {
+      prop->alive = false;
+      sim->num_props_alive--;
+
+      sim->cat_face.cur_animation = prop->broken == BROKEN ? 2 : 1;
+    }
+    else if (cat_body->position.x + cat_body->display_dims.x > prop->position.x
+      && cat_body->position.x + cat_body->display_dims.x < prop->position.x + prop->sheet->image_dims.x/2
+      && cat_body->cur_animation == PUNCH) {
+      //NOTE: The punch scenario is in reach every step, the bench would time the console.
+      if (!scenario) SDL_Log("Punch distance!");
+      prop->hp--;
+      if (prop->hp <= 0) {
+        prop->alive = false;
+        sim->num_props_alive--;
+      }
+    }
+  }
+}
+
+//NOTE: Runs the steps dt seconds of game time call for and publishes the
+// result if there were any. The steps are fixed at SIM_DT, the rest carries
+// over. After a stall (loading, a dragged window) at most SIM_MAX_STEPS are
+// caught up and the rest is dropped, so slow steps cannot pile up more steps.
+void simulation_advance(Simulation *sim, f64 dt, u64 now) {
+  sim->accumulator += dt;
+  if (sim->accumulator > SIM_MAX_STEPS * SIM_DT) {
+    sim->dropped_sec += sim->accumulator - SIM_MAX_STEPS * SIM_DT;
+    sim->accumulator = SIM_MAX_STEPS * SIM_DT;
+  }
+
+  int num_steps = 0;
+  PROFILE_BEGIN("simulate");
+  for (; sim->accumulator >= SIM_DT; sim->accumulator -= SIM_DT, ++num_steps) simulation_step(sim);
+  PROFILE_END();
+  if (num_steps > 0) simulation_publish(sim, now);
+}
+
+// How far now is between the last two steps of snapshot, in [0, 1].
+f32 simulation_alpha(FrameSnapshot *snapshot, u64 now) {
+  f64 since = now > snapshot->time ? (f64)(now - snapshot->time) / SDL_GetPerformanceFrequency() : 0.0;
+  return (f32)SDL_min(since / SIM_DT, 1.0);
+}
+
+//NOTE: Steps whenever one is due and sleeps in between, independent of how
+// fast frames are drawn.
+static int SDLCALL simulation_thread(void *data) {
+  Simulation *sim = data;
+  PROFILE_THREAD_NAME("simulation");
+  u64 frequency = SDL_GetPerformanceFrequency();
+  u64 last = SDL_GetPerformanceCounter();
+  while (!SDL_GetAtomicInt(&sim->quit)) {
+    u64 now = SDL_GetPerformanceCounter();
+    simulation_advance(sim, (f64)(now - last) / frequency, now);
+    last = now;
+    SDL_DelayPrecise((u64)((SIM_DT - sim->accumulator) * 1e9));
+  }
+  return 0;
+}
+
+b8 simulation_start_thread(Simulation *sim) {
+  sim->thread = SDL_CreateThread(simulation_thread, "simulation", sim);
+  if (!sim->thread) SDL_Log("Simulation thread could not be created, simulating on the main thread: %s", SDL_GetError());
+  return sim->thread != NULL;
+}
+
+void simulation_stop_thread(Simulation *sim) {
+  if (!sim->thread) return;
+  SDL_SetAtomicInt(&sim->quit, 1);
+  SDL_WaitThread(sim->thread, NULL);
+  sim->thread = NULL;
+}
+
 int main(int argc, char **argv)
 {
+  u64 time_stamp_startup = SDL_GetPerformanceCounter();
+
+  u64 texture_budget_mb = 48;
+  enum TextureQuality texture_quality = TEXTURE_QUALITY_HIGH;
+  b8 bench_kernels = false;
+  b8 bench_raster = false;
+  b8 use_soft_raster = false;
+  int raster_threads = 0; // 0 = one per core
+  int dirty_rects_mode = -1; // -1 = only when the CPU draws
+  Headless headless = {0};
+  FrameBench frame_bench = {0};
+  b8 vsync = true;
+  const char *trace_path = NULL;
+  b8 dynamic_res = false;
+  b8 sim_thread = true;
+  LatencyTracker latency = {0};
+  f64 target_fps = 0; // 0 = vsync, or the display's rate if vsync fails
+  f32 res_scale = 0; // 0 = not fixed
+  b8 check_front_belt = false;
+  for (int i = 1; i < argc; ++i) {
+    //NOTE: --headless N, --dt S, --seed N, --dump-frames DIR, --frame-crc FILE|-
+    if (headless_parse_arg(&headless, argc, argv, &i))
+      continue;
+    else if (SDL_strcmp(argv[i], "--texture-budget-mb") == 0 && i + 1 < argc)
+      texture_budget_mb = SDL_strtoull(argv[++i], NULL, 10);
+    //NOTE: Low quality stores the opaque backgrounds as RGB565, half the memory.
+    else if (SDL_strcmp(argv[i], "--texture-quality") == 0 && i + 1 < argc)
+      texture_quality = SDL_strcmp(argv[++i], "low") == 0 ? TEXTURE_QUALITY_LOW : TEXTURE_QUALITY_HIGH;
+    else if (SDL_strcmp(argv[i], "--bench-kernels") == 0)
+      bench_kernels = true;
+    else if (SDL_strcmp(argv[i], "--bench-raster") == 0)
+      bench_raster = true;
+    //NOTE: soft = our own CPU rasterizer, sdl = whatever SDL_CreateRenderer
+    // picks (SDL_RENDER_DRIVER=software forces SDL's software renderer).
+    else if (SDL_strcmp(argv[i], "--raster") == 0 && i + 1 < argc)
+      use_soft_raster = SDL_strcmp(argv[++i], "soft") == 0;
+    else if (SDL_strcmp(argv[i], "--raster-threads") == 0 && i + 1 < argc)
+      raster_threads = SDL_atoi(argv[++i]);
+    else if (SDL_strcmp(argv[i], "--dirty-rects") == 0)
+      dirty_rects_mode = 1;
+    else if (SDL_strcmp(argv[i], "--no-dirty-rects") == 0)
+      dirty_rects_mode = 0;
+    else if (SDL_strcmp(argv[i], "--no-vsync") == 0)
+      vsync = false;
+    //NOTE: Draws at 50-100% of 1920x1080, following the frame time, and
+    // stretches that over the window. --res-scale S fixes it at S instead.
+    else if (SDL_strcmp(argv[i], "--dynamic-res") == 0)
+      dynamic_res = true;
+    else if (SDL_strcmp(argv[i], "--res-scale") == 0 && i + 1 < argc)
+      res_scale = (f32)SDL_atof(argv[++i]);
+    //NOTE: Simulate and draw one after the other on the main thread.
+    else if (SDL_strcmp(argv[i], "--no-sim-thread") == 0)
+      sim_thread = false;
+    //NOTE: Histogram of SPACE press to present times, logged with F3 and at exit.
+    else if (SDL_strcmp(argv[i], "--latency") == 0)
+      latency.measure = true;
+    //NOTE: Caps the frame rate with the frame pacer, vsync or not.
+    else if (SDL_strcmp(argv[i], "--fps") == 0 && i + 1 < argc)
+      target_fps = SDL_atof(argv[++i]);
+    //NOTE: Polls input and draws right before the next vblank, needs vsync.
+    else if (SDL_strcmp(argv[i], "--low-latency") == 0)
+      latency.low_latency = true;
+    //NOTE: Chrome trace of the profiler's rings at exit, F5 writes one any time.
+    else if (SDL_strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+      trace_path = argv[++i];
+    //NOTE: idle, props, punch or stress, see bench_scenarios in frame_bench.c.
+    else if (SDL_strcmp(argv[i], "--scenario") == 0 && i + 1 < argc) {
+      frame_bench.scenario = bench_scenario_find(argv[++i]);
+      if (!frame_bench.scenario) SDL_Log("Unknown scenario %s", argv[i]);
+    }
+    else if (SDL_strcmp(argv[i], "--bench-json") == 0 && i + 1 < argc)
+      frame_bench.json_path = argv[++i];
+    else if (SDL_strcmp(argv[i], "--bench-baseline") == 0 && i + 1 < argc)
+      frame_bench.baseline_path = argv[++i];
+    else if (SDL_strcmp(argv[i], "--bench-tolerance") == 0 && i + 1 < argc)
+      frame_bench.tolerance = SDL_atof(argv[++i]) / 100.0;
+    //NOTE: Headless only, fails the run if anything shows over the front belt.
+    else if (SDL_strcmp(argv[i], "--check-front-belt") == 0)
+      check_front_belt = true;
+  }
+  b8 bench_frames = frame_bench.scenario || frame_bench.json_path || frame_bench.baseline_path;
+  const BenchScenario *scenario = frame_bench.scenario;
 
   //NOTE(moritz): Initialization
+  headless_configure(&headless);
   if (!SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO))
   {
     SDL_Log("Could not initialize SDL: %s", SDL_GetError());
     return 1;
   }
+  profiler_init();
 
+  AssetPack asset_pack;
+#ifdef EMBEDDED_ASSETS
+  //NOTE: The pack is linked into the executable, startup does not touch the filesystem.
+  asset_pack_open_memory(&asset_pack, embedded_pack, (u64)(embedded_pack_end - embedded_pack));
+#else
   const char *base_path = SDL_GetBasePath();
   SDL_Log("%s", base_path);
 
   char path_temp_buffer[256];
+  asset_pack_open(&asset_pack, make_path(path_temp_buffer, sizeof(path_temp_buffer), (char *)(base_path ? base_path : ""), "assets.pack"));
+#endif
+
+  if (bench_kernels || bench_raster)
+  {
+    b8 ok = bench_kernels ? kernel_bench_run(&asset_pack) : raster_bench_run(&asset_pack);
+    asset_pack_close(&asset_pack);
+    SDL_Quit();
+    return ok ? 0 : 1;
+  }
 
   SDL_Window *main_window = SDL_CreateWindow("SDL Window",
                                              1920,
@@ -437,11 +813,135 @@ int main(int argc, char **argv)
     return 1;
   }
 
-  if (!SDL_SetRenderVSync(renderer, 1))
+  b8 vsync_failed = false;
+  if (vsync && !headless.enabled && !SDL_SetRenderVSync(renderer, 1))
+  {
+    SDL_Log("Was not able to set vsync, the frame pacer takes over");
+    vsync = false;
+    vsync_failed = true;
+  }
+
+  //NOTE: Headless runs go as fast as they can, --no-vsync alone too (benchmarks).
+  FramePacer pacer;
+  frame_pacer_init(&pacer, main_window, vsync_failed || target_fps > 0, target_fps);
+  if (!headless.enabled) frame_pacer_window_changed(&pacer, main_window);
+
+  latency_init(&latency, main_window);
+  if (latency.low_latency && (!vsync || headless.enabled))
+  {
+    SDL_Log("Low latency mode needs vsync, turned off");
+    latency.low_latency = false;
+  }
+
+  //NOTE: Room for the whole frame up front, so it is sorted in one piece
+  // and the queue does not have to grow during the first busy frame.
+  static SpriteBatch sprite_batch;
+  sprite_batch_init(&sprite_batch, renderer);
+  sprite_batch_reserve(&sprite_batch, MAX_FRAME_QUADS);
+
+
+  ResourceRegistry resources = {0};
+
+  //NOTE: Has to exist before anything is loaded, textures only keep a CPU
+  // copy for it once it is there.
+  static SoftRaster soft_raster;
+  if (use_soft_raster && soft_raster_init(&soft_raster, renderer, &resources, 1920, 1080, raster_threads))
+    sprite_batch_use_soft_raster(&sprite_batch, &soft_raster);
+
+  Atlas atlas = {0};
+  AssetLoader asset_loader;
+  if (!asset_loader_init(&asset_loader, renderer, &asset_pack, &atlas, &resources))
   {
-    SDL_Log("Was not able to set vsync");
+    return 1;
+  }
+  asset_loader_set_quality(&asset_loader, texture_quality);
+
+  //NOTE: The controller times real frames, a headless run stays deterministic
+  // with a fixed scale only.
+  static DynamicRes dynres;
+  if (dynamic_res && headless.enabled) {
+    SDL_Log("--dynamic-res is ignored in headless runs, use --res-scale");
+    dynamic_res = false;
+  }
+  if ((dynamic_res || res_scale > 0) && dynamic_res_init(&dynres, renderer, sprite_batch.raster, &resources, 1920, 1080)) {
+    dynres.adaptive = dynamic_res;
+    dynamic_res_set_budget(&dynres, main_window);
+    if (res_scale > 0) dynamic_res_set_scale(&dynres, res_scale);
+    sprite_batch_use_dynamic_res(&sprite_batch, &dynres);
   }
 
+  //NOTE: Redrawing only what changed pays off when the CPU does the blending.
+  // Not with dynamic resolution, a scale change redraws everything anyway.
+  static DirtyTracker dirty_tracker;
+  const char *renderer_name = SDL_GetRendererName(renderer);
+  b8 software_renderer = renderer_name && SDL_strcmp(renderer_name, SDL_SOFTWARE_RENDERER) == 0;
+  if (sprite_batch.dynres && dirty_rects_mode == 1) SDL_Log("Dirty rects do not work with dynamic resolution, turned off");
+  if (!sprite_batch.dynres && (dirty_rects_mode == 1 || (dirty_rects_mode == -1 && (software_renderer || sprite_batch.raster)))) {
+    //NOTE: The soft raster's framebuffer keeps its pixels, no canvas needed.
+    if (dirty_init(&dirty_tracker, sprite_batch.raster ? NULL : renderer, &resources, 1920, 1080)) {
+      dirty_reserve(&dirty_tracker, MAX_FRAME_QUADS);
+      sprite_batch_use_dirty_rects(&sprite_batch, &dirty_tracker);
+    }
+  }
+  SDL_Log("renderer: %s, raster: %s, dirty rects %s, dynamic resolution %s", renderer_name,
+          sprite_batch.raster ? "soft" : "sdl", sprite_batch.dirty ? "on" : "off",
+          !sprite_batch.dynres ? "off" : dynres.adaptive ? "adaptive" : "fixed");
+
+  //NOTE: Kick off every load up front so reads and decodes overlap.
+  // The cat sheets have 1000x1000 frames but are only ever shown at 356x356.
+  LoadParams cat_params = { .cols = 3, .rows = 1, .cell_w = 1000, .cell_h = 1000, .display_dims = {356., 356.} };
+  LoadParams prop_params = { .flags = LOAD_ATLAS, .cols = 2, .rows = 1 };
+
+  TexHandle cat_tail_handle = asset_loader_request_ex(&asset_loader, "cat_animation_tail.png", &cat_params);
+  TexHandle cat_face_handle = asset_loader_request_ex(&asset_loader, "cat_animation_face.png", &cat_params);
+  TexHandle cat_body_handle = asset_loader_request_ex(&asset_loader, "cat_animation_body.png", &cat_params);
+  TexHandle spawn_handle    = asset_loader_request(&asset_loader, "conveyorbelt_static1.png", LOAD_DEFAULT);
+  TexHandle spawn_bg_handle = asset_loader_request(&asset_loader, "conveyorbelt_interior.png", LOAD_DEFAULT);
+  TexHandle belt_handle     = asset_loader_request(&asset_loader, "conveyorbelt_frontwheel1.png", LOAD_DEFAULT);
+  TexHandle wheels_handle   = asset_loader_request(&asset_loader, "conveyorbelt_circle1.png", LOAD_ATLAS);
+  TexHandle dot_handle      = asset_loader_request(&asset_loader, "conveyorbelt_dot1.png", LOAD_ATLAS);
+
+  TexHandle prop_handles[NUM_TYPES];
+  prop_handles[DUCK]   = asset_loader_request_ex(&asset_loader, "item_duck.png", &prop_params);
+  prop_handles[VASE]   = asset_loader_request_ex(&asset_loader, "item_vase.png", &prop_params);
+  prop_handles[TOSTER] = asset_loader_request_ex(&asset_loader, "item_toster.png", &prop_params);
+  prop_handles[FLOWER] = asset_loader_request_ex(&asset_loader, "item_flower.png", &prop_params);
+  prop_handles[LAMP]   = asset_loader_request_ex(&asset_loader, "item_lamp.png", &prop_params);
+  prop_handles[PC]     = asset_loader_request_ex(&asset_loader, "item_computer.png", &prop_params);
+  prop_handles[PLANT]  = asset_loader_request_ex(&asset_loader, "item_plant.png", &prop_params);
+  prop_handles[STATUE] = asset_loader_request_ex(&asset_loader, "item_statue.png", &prop_params);
+  prop_handles[MIRROR] = asset_loader_request_ex(&asset_loader, "item_mirror.png", &prop_params);
+  prop_handles[BEAR]   = asset_loader_request_ex(&asset_loader, "item_bear.png", &prop_params);
+
+  //NOTE: Full screen backgrounds and the 3840x2400 boss screens only come in
+  // when needed and leave again when the budget runs out.
+  Residency residency;
+  residency_init(&residency, &asset_loader, texture_budget_mb * 1024 * 1024);
+
+  //NOTE: The background is the opaque room plus one of the translucent light
+  // overlays (or none). Both are composited into bg_cache once per change.
+  LoadParams background_params = { 0 };
+  ResidentHandle bg_base_handle = residency_register(&residency, "background_nolight1.png", &background_params);
+  ResidentHandle bg_light_handles[] = {
+    INVALID_RESIDENT_HANDLE,
+    residency_register(&residency, "background_lights1.png", &background_params),
+    residency_register(&residency, "background_lights_red.png", &background_params),
+  };
+  int bg_variant = 0;
+  int wanted_bg_variant = 0;
+  residency_prefetch(&residency, bg_base_handle);
+
+  LayerCache bg_cache;
+  layer_cache_init(&bg_cache, renderer, &resources, "background cache", 1920, 1080);
+  if (sprite_batch.raster) layer_cache_use_soft_raster(&bg_cache, sprite_batch.raster);
+
+  LoadParams boss_params = { .display_dims = {1920., 1200.} };
+  ResidentHandle boss_neutral_handle = residency_register(&residency, "cat_boss_neutral.png", &boss_params);
+  ResidentHandle boss_loose_handle   = residency_register(&residency, "cat_boss_loose1.png", &boss_params);
+  b8 boss_phase = false;
+
+  asset_loader_wait_all(&asset_loader);
+  residency_update(&residency);
 
   Input previous_input = {0};
 
@@ -465,8 +965,7 @@ int main(int argc, char **argv)
     .position = cat_pos,
     .frame_dims = {1000.f, 1000.f},
     .display_dims = {356.,  356.},
-    // TODO: free mem
-    .spr_tex = load_tex_from_png(renderer, "../res/cat_animation_tail.png"),
+    .sheet = asset_loader_get_sheet(&asset_loader, cat_tail_handle),
   };
 
   v2 ok_face[] = { {0, 0} };
@@ -485,8 +984,7 @@ int main(int argc, char **argv)
     .position = cat_pos,
     .frame_dims = {1000.f, 1000.f},
     .display_dims = {356., 356.},
-    // TODO: free mem
-    .spr_tex = load_tex_from_png(renderer, "../res/cat_animation_face.png"),
+    .sheet = asset_loader_get_sheet(&asset_loader, cat_face_handle),
   };
 
   v2   idle1[] = { {0, 0} };
@@ -504,8 +1002,7 @@ int main(int argc, char **argv)
     .position = cat_pos,
     .frame_dims = {1000.f, 1000.f},
     .display_dims = {356., 356.},
-    // TODO: free mem
-    .spr_tex = load_tex_from_png(renderer, "../res/cat_animation_body.png"),
+    .sheet = asset_loader_get_sheet(&asset_loader, cat_body_handle),
   };
   player_pos.x = cat_ani.position.x;
   player_pos.y = cat_ani.position.y;
@@ -537,77 +1034,97 @@ int main(int argc, char **argv)
     SDL_Log("animation %d: num of frames: %d",i, animations[i].num_frames);
   }
 
-  SDL_Texture *bg_tex = load_tex_from_png(renderer, "../res/background_nolight1.png");
-  SDL_Texture *spawn = load_tex_from_png(renderer, "../res/conveyorbelt_static1.png");
-  SDL_Texture *spawn_bg = load_tex_from_png(renderer, "../res/conveyorbelt_interior.png");
-  SDL_Texture *belt = load_tex_from_png(renderer, "../res/conveyorbelt_frontwheel1.png");
-  SDL_Texture *wheels = load_tex_from_png(renderer, "../res/conveyorbelt_circle1.png");
-  SDL_Texture *dot = load_tex_from_png(renderer, "../res/conveyorbelt_dot1.png");
-
-  SDL_Texture* prop_textures[NUM_TYPES];
-  for(int i = 0; i < NUM_TYPES; ++i) prop_textures[i] = NULL;
-
-  // TODO: free mem
-  prop_textures[DUCK] = load_tex_from_png(renderer, "../res/item_duck.png");
-  prop_textures[VASE] = load_tex_from_png(renderer, "../res/item_vase.png");
-  prop_textures[TOSTER] = load_tex_from_png(renderer, "../res/item_toster.png");
-  prop_textures[FLOWER] = load_tex_from_png(renderer, "../res/item_flower.png");
-  prop_textures[LAMP] = load_tex_from_png(renderer, "../res/item_lamp.png");
-  prop_textures[PC] = load_tex_from_png(renderer, "../res/item_computer.png");
-  prop_textures[PLANT] = load_tex_from_png(renderer, "../res/item_plant.png");
-  prop_textures[STATUE] = load_tex_from_png(renderer, "../res/item_statue.png");
-  prop_textures[MIRROR] = load_tex_from_png(renderer, "../res/item_mirror.png");
-  prop_textures[BEAR] = load_tex_from_png(renderer, "../res/item_bear.png");
+  Sprite spawn = asset_loader_get_sprite(&asset_loader, spawn_handle);
+  Sprite spawn_bg = asset_loader_get_sprite(&asset_loader, spawn_bg_handle);
+  Sprite belt = asset_loader_get_sprite(&asset_loader, belt_handle);
+  Sprite wheels = asset_loader_get_sprite(&asset_loader, wheels_handle);
+  Sprite dot = asset_loader_get_sprite(&asset_loader, dot_handle);
+
+  Conveyor conveyor;
+  conveyor_init(&conveyor, &conveyor_default_layout);
+  conveyor_set_sprites(&conveyor, spawn_bg, spawn, belt, wheels, dot);
+
+  SpriteSheet prop_sheets[NUM_TYPES];
+  for(int i = 0; i < NUM_TYPES; ++i) prop_sheets[i] = asset_loader_get_sheet(&asset_loader, prop_handles[i]);
+
+  atlas_seal(&atlas);
+  SDL_Log("Atlas: %d pages", atlas.num_pages);
+
+  SDL_Log("assets loaded after %.3f ms", (SDL_GetPerformanceCounter() - time_stamp_startup) * 1000.0 / SDL_GetPerformanceFrequency());
 
   u64 time_stamp_now  = SDL_GetPerformanceCounter();
-  u64 time_stamp_last = 0;
+  u64 time_stamp_last = time_stamp_now;
   f64 dt_for_previous_frame = 0;
 
   //NOTE(moritz): Game loop
   b8 quit = false;
 
-  int angle = 0.f;
-  f32 dot_shift = 0;
+  Prop myprop = create_prop_rand(0, prop_sheets);
 
-  // spawn settings
-  f64 spawn_timout_sec_min = 1; // sec
-  f64 spawn_timout_sec_max = 3; // sec
-  f64 cur_spawn_timeout;
-  f64 spawn_elapsed;
+  //NOTE: The simulation gets its own thread, so the next steps run while this
+  // one draws and presents. Headless runs step on the main thread, once per
+  // frame with the fixed dt, to stay deterministic.
+  static Simulation sim;
+  simulation_init(&sim, &cat_tail_obj, &cat_ani, &cat_face_obj, &conveyor, prop_sheets, scenario);
+  FrameSnapshot *snapshot = triple_buffer_acquire(&sim.snapshots);
 
-  const int prop_spawn_limit = 20;
-  Prop prop_list[prop_spawn_limit];
-  for (int i = 0; i < prop_spawn_limit; ++i) prop_list[i] = (Prop){.alive =  false};
-  int num_props_alive = 0;
+  b8 first_frame = true;
+  if (headless.enabled && !headless_begin(&headless))
+  {
+    return 1;
+  }
+
+  //NOTE: The front belt drawn alone, over black and over white, shows which
+  // pixels it covers. No frame may show anything else there, e.g. props that
+  // ended up above it because the batch was sorted in pieces. The same quad
+  // has to come out the same way, so only with SDL's renderer at full size.
+  if (check_front_belt && (!headless.enabled || sprite_batch.raster || sprite_batch.dynres)) {
+    SDL_Log("--check-front-belt needs --headless without --raster soft or a resolution scale, turned off");
+  }
+  else if (check_front_belt) {
+    SDL_Surface *alone[2];
+    for (int i = 0; i < 2; ++i) {
+      SpriteBatch front_only;
+      sprite_batch_init(&front_only, renderer);
+      SDL_SetRenderDrawColor(renderer, 255 * i, 255 * i, 255 * i, 255);
+      SDL_RenderClear(renderer);
+      conveyor_draw_front(&conveyor, &front_only);
+      sprite_batch_flush(&front_only);
+      sprite_batch_destroy(&front_only);
+      alone[i] = headless_read_frame(renderer);
+    }
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+    b8 occluder_set = headless_set_occluder(&headless, alone[0], alone[1]);
+    SDL_DestroySurface(alone[0]);
+    SDL_DestroySurface(alone[1]);
+    if (!occluder_set) return 1;
+  }
 
-  Prop myprop = create_prop_rand(0, prop_textures);
+  if (bench_frames) frame_bench_begin(&frame_bench);
+  if (sim_thread && !headless.enabled) simulation_start_thread(&sim);
   // before main loop
   while (!quit)
   {
+    latency_wait_for_vblank(&latency);
     time_stamp_last = time_stamp_now;
     time_stamp_now  = SDL_GetPerformanceCounter();
     dt_for_previous_frame = (f64)((time_stamp_now - time_stamp_last)/(f64)SDL_GetPerformanceFrequency());
     // SDL_Log("dt: %g seconds", dt_for_previous_frame);
+    if (headless.enabled) dt_for_previous_frame = headless.dt;
+    profiler_frame();
 
-    // spawn behavior
-    spawn_elapsed += dt_for_previous_frame;
-    if (spawn_elapsed > cur_spawn_timeout) {
-      spawn_elapsed = 0.;
-      cur_spawn_timeout = spawn_timout_sec_min + (spawn_timout_sec_max - spawn_timout_sec_min)*rand_0_to_1();
-      if (num_props_alive < prop_spawn_limit) {
-        int free_spot = -1;
-        for (int i = 0; i < prop_spawn_limit; ++i )
-          if (prop_list[i].alive == false) free_spot = i;
-
-        if (free_spot > -1 && free_spot < prop_spawn_limit) {
-          prop_list[free_spot] = create_prop_rand(rand() % 3, prop_textures);
-          num_props_alive++;
-        }
-      }
-    }
+    //NOTE: Headless runs finish every load right away, so a frame never
+    // depends on how fast the loader threads were.
+    PROFILE_BEGIN("assets");
+    if (headless.enabled) asset_loader_wait_all(&asset_loader);
+    else asset_loader_pump(&asset_loader);
+    residency_update(&residency);
+    PROFILE_END();
 
     //NOTE(moritz): Events/Input
+    PROFILE_BEGIN("input");
     Input current_input = {0};
+    u32 punch_input = 0;
     current_input = previous_input;
 
     for (s32 idx = 0; idx < SDL_SCANCODE_COUNT; idx += 1)
@@ -627,6 +1144,25 @@ int main(int argc, char **argv)
           quit = true;
         } break;
 
+        case SDL_EVENT_WINDOW_FOCUS_GAINED:
+        case SDL_EVENT_WINDOW_FOCUS_LOST:
+        case SDL_EVENT_WINDOW_MINIMIZED:
+        case SDL_EVENT_WINDOW_RESTORED:
+        case SDL_EVENT_WINDOW_SHOWN:
+        case SDL_EVENT_WINDOW_HIDDEN:
+        case SDL_EVENT_WINDOW_OCCLUDED:
+        case SDL_EVENT_WINDOW_EXPOSED:
+        {
+          if (!headless.enabled) frame_pacer_window_changed(&pacer, main_window);
+        } break;
+
+        case SDL_EVENT_RENDER_TARGETS_RESET:
+        case SDL_EVENT_RENDER_DEVICE_RESET:
+        {
+          layer_cache_invalidate(&bg_cache);
+          sprite_batch_invalidate(&sprite_batch);
+        } break;
+
         case SDL_EVENT_KEY_DOWN:
         {
           int scancode = e.key.scancode;
@@ -635,6 +1171,7 @@ int main(int argc, char **argv)
           current_input.buttons[scancode].pressed = true;
 
           if(scancode == SDL_SCANCODE_ESCAPE) quit = true;
+          if(scancode == SDL_SCANCODE_SPACE && !e.key.repeat) punch_input = latency_input(&latency, e.key.timestamp);
         } break;
         case SDL_EVENT_KEY_UP:
         {
@@ -647,154 +1184,189 @@ int main(int argc, char **argv)
     }
 
     previous_input = current_input;
+    PROFILE_END();
+
+    if (scenario && scenario->punch) current_input.buttons[SDL_SCANCODE_SPACE].down = true;
 
-    if (current_input.buttons[SDL_SCANCODE_SPACE].down)
-      //myprop = create_prop_rand(2, prop_textures);
-        animation_obj_start(&cat_ani, PUNCH);
+    if (current_input.buttons[SDL_SCANCODE_L].pressed) {
+      wanted_bg_variant = (wanted_bg_variant + 1) % LEN(bg_light_handles);
+      residency_prefetch(&residency, bg_base_handle);
+      residency_prefetch(&residency, bg_light_handles[wanted_bg_variant]);
+    }
+    if (wanted_bg_variant != bg_variant
+        && residency_is_resident(&residency, bg_base_handle)
+        && (wanted_bg_variant == 0 || residency_is_resident(&residency, bg_light_handles[wanted_bg_variant])))
+      bg_variant = wanted_bg_variant;
+
+    if (current_input.buttons[SDL_SCANCODE_F3].pressed) {
+      resources_report(&resources);
+      residency_report(&residency);
+      sprite_batch_report(&sprite_batch);
+      SDL_Log("simulation: %d Hz on the %s thread, %llu steps, %.3f s dropped after stalls, %d of %d snapshots never drawn",
+              SIM_HZ, sim.thread ? "simulation" : "main", (unsigned long long)snapshot->steps, snapshot->dropped_sec,
+              SDL_GetAtomicInt(&sim.snapshots.num_overwritten), SDL_GetAtomicInt(&sim.snapshots.num_published));
+      latency_report(&latency);
+      frame_pacer_report(&pacer);
+    }
+
+    if (current_input.buttons[SDL_SCANCODE_F4].pressed) profiler_toggle_overlay();
+    if (current_input.buttons[SDL_SCANCODE_F5].pressed) profiler_write_trace("profile_trace.json");
+
+    if (current_input.buttons[SDL_SCANCODE_B].pressed) {
+      boss_phase = !boss_phase;
+      if (boss_phase) {
+        // Hint: the boss screen is coming, get both moods in.
+        residency_prefetch(&residency, boss_neutral_handle);
+        residency_prefetch(&residency, boss_loose_handle);
+      }
+    }
+
+    //NOTE: Presses are counted, so a tap between two steps still punches.
+    if (current_input.buttons[SDL_SCANCODE_SPACE].pressed) {
+      //myprop = create_prop_rand(2, prop_sheets);
+      if (punch_input) SDL_SetAtomicInt(&sim.punch_input, (int)punch_input);
+      SDL_AddAtomicInt(&sim.punches, 1);
+    }
+    SDL_SetAtomicInt(&sim.punch_held, current_input.buttons[SDL_SCANCODE_SPACE].down);
 
 
     //NOTE(moritz):Update game state
     v2 input_direction = {0};
 
+    //NOTE: The newest finished state, drawn a fraction of a step behind it.
+    // Without a simulation thread, the frame's steps run right here.
+    if (!sim.thread) simulation_advance(&sim, dt_for_previous_frame, time_stamp_now);
+    snapshot = triple_buffer_acquire(&sim.snapshots);
+    latency_frame_shows(&latency, snapshot->input_seq);
+    f32 sim_alpha = simulation_alpha(snapshot, sim.thread ? SDL_GetPerformanceCounter() : time_stamp_now);
+
     //NOTE(moritz): Drawing
-    if (bg_tex) {
-      SDL_RenderTexture(renderer, bg_tex, NULL, NULL);
+    PROFILE_BEGIN("background");
+    sprite_batch_begin_frame(&sprite_batch);
+    //NOTE: Every sprite goes through the batch, the RenderLayer decides what ends
+    // up on top. Placeholders too (sprite_batch_fill), so nothing is drawn
+    // around it.
+    if (!layer_cache_valid(&bg_cache, (u64)bg_variant)) {
+      SpriteSheet *bg_base = residency_use(&residency, bg_base_handle);
+      SpriteSheet *bg_light = bg_variant ? residency_use(&residency, bg_light_handles[bg_variant]) : NULL;
+      if (bg_base && (bg_variant == 0 || bg_light) && layer_cache_begin(&bg_cache, bg_base->frames[0].alpha == ALPHA_OPAQUE)) {
+        layer_cache_draw(&bg_cache, &bg_base->frames[0], &(SDL_FRect){0, 0, 1920, 1080});
+        if (bg_light) layer_cache_draw(&bg_cache, &bg_light->frames[0], &(SDL_FRect){0, 0, 1920, 1080});
+        layer_cache_end(&bg_cache, (u64)bg_variant);
+        sprite_batch_invalidate(&sprite_batch);
+        SDL_Log("background cache rebuilt for variant %d (%u rebuilds)", bg_variant, bg_cache.num_rebuilds);
+      }
+    }
+
+    Sprite *bg_sprite = layer_cache_sprite(&bg_cache);
+    if (bg_sprite) {
+      sprite_batch_draw(&sprite_batch, LAYER_BACKGROUND, 0, bg_sprite, &(SDL_FRect){0, 0, 1920, 1080});
     }
     else {
-      SDL_SetRenderDrawColor(renderer, 255, 0, 255, 255);
-      SDL_RenderClear(renderer);
+      sprite_batch_fill(&sprite_batch, LAYER_BACKGROUND, &(SDL_FRect){0, 0, 1920, 1080}, (SDL_Color){255, 0, 255, 255});
     }
+    PROFILE_END();
 
 
-    if(cat_tail_obj.spr_tex) {
-      //NOTE(moritz): Hack
-      cat_ani.position.x = player_pos.x;
-      cat_ani.position.y = player_pos.y;
-      //update_animation(&animations[0], dt_for_previous_frame);
+    PROFILE_BEGIN("cat");
+    if(sheet_is_loaded(&cat_tail_obj.sheet)) {
       //display_animation(sndplr_pos, &animations[0], spr_dims, spr_tex, renderer);
-      display_animated_object(&cat_tail_obj, renderer);
-      update_animated_object(&cat_tail_obj, dt_for_previous_frame);
+      display_animated_object(&cat_tail_obj, snapshot->cat_frames[0], &sprite_batch, LAYER_CAT_TAIL);
     }
 
 
-    if(cat_ani.spr_tex) {
-      //NOTE(moritz): Hack
-      cat_ani.position.x = player_pos.x;
-      cat_ani.position.y = player_pos.y;
-      //update_animation(&animations[0], dt_for_previous_frame);
+    if(sheet_is_loaded(&cat_ani.sheet)) {
       //display_animation(sndplr_pos, &animations[0], spr_dims, spr_tex, renderer);
-      update_animated_object(&cat_ani, dt_for_previous_frame);
-      display_animated_object(&cat_ani, renderer);
+      display_animated_object(&cat_ani, snapshot->cat_frames[1], &sprite_batch, LAYER_CAT_BODY);
     }
     else {
-      SDL_SetRenderDrawColor(renderer, 0, 255, 0, 255);
       SDL_FRect rect = (SDL_FRect){
         .x = player_pos.x - sndplr_HALF_DIM,
         .y = player_pos.y - sndplr_HALF_DIM,
         .w = 2*sndplr_HALF_DIM,
         .h = 2*sndplr_HALF_DIM
       };
-      SDL_RenderFillRect(renderer, &rect);
+      sprite_batch_fill(&sprite_batch, LAYER_CAT_BODY, &rect, (SDL_Color){0, 255, 0, 255});
     }
 
-    if(cat_face_obj.spr_tex) {
-      //NOTE(moritz): Hack
-      cat_ani.position.x = player_pos.x;
-      cat_ani.position.y = player_pos.y;
-      //update_animation(&animations, dt_for_previous_frame);
-      update_animated_object(&cat_face_obj, dt_for_previous_frame);
-      display_animated_object(&cat_face_obj, renderer);
+    if(sheet_is_loaded(&cat_face_obj.sheet)) {
+      display_animated_object(&cat_face_obj, snapshot->cat_frames[2], &sprite_batch, LAYER_CAT_FACE);
     }
+    PROFILE_END();
 
-    if (spawn_bg) {
-      SDL_RenderTexture(renderer, spawn_bg, NULL, &(SDL_FRect){0, 0, spawn_bg->w, spawn_bg->h});
-    }
-    else {
-      SDL_SetRenderDrawColor(renderer, 255, 0, 255, 255);
-      SDL_RenderFillRect(renderer, &(SDL_FRect){0, 890, 400, 400});
-    }
+    //NOTE: Belt textures, wheels and dots. Their layers put the props in between.
+    PROFILE_BEGIN("belt");
+    conveyor.motion = snapshot->conveyor;
+    conveyor_draw(&conveyor, &sprite_batch, sim_alpha);
+    PROFILE_END();
 
     // item placing
+    PROFILE_BEGIN("props");
 
-    for (int i = 0; i < prop_spawn_limit; ++i) {
-      Prop *prop = &prop_list[i];
-      if (prop->alive) {
-        prop->position.x -= dt_for_previous_frame * 300;
-        display_prop(prop, renderer);
-        if (prop->position.x < -prop->texture->w) {
-          prop->alive = false;
-          num_props_alive--;
-
-          cat_face_obj.cur_animation = prop->broken == BROKEN ? 2 : 1;
-        }
-        else if (cat_ani.position.x + cat_ani.display_dims.x > prop->position.x
-          && cat_ani.position.x + cat_ani.display_dims.x < prop->position.x + prop->texture->w/2
-          && cat_ani.cur_animation == PUNCH) {
-          SDL_Log("Punch distance!");
-          prop->hp--;
-          if (prop->hp <= 0) prop->alive = false;
-        }
-
-      }
-    }
-
-    if (spawn) {
-      SDL_RenderTexture(renderer, spawn, NULL, &(SDL_FRect){0, 0, spawn->w, spawn->h});
-    }
-    else {
-      SDL_SetRenderDrawColor(renderer, 255, 0, 255, 255);
-      SDL_RenderFillRect(renderer, &(SDL_FRect){0, 890, 400, 400});
-    }
-
-    if (wheels) {
-      SDL_FPoint center = {wheels->w/2 + rand_minus_one_to_one(), wheels->h/2 + rand_minus_one_to_one()};
-      f32 posxs[] = {98, 300, 490, 664, 827, 1026, 1219, 1432};
-      angle -= 290. * dt_for_previous_frame;
-      // angle = angle < 0 ? 360 : 0;
-      for (int i = 0; i < LEN(posxs); i++)
-        SDL_RenderTextureRotated(renderer, wheels, NULL,
-          &(SDL_FRect){posxs[i] - center.x, 990 - center.y, wheels->w, wheels->h}, angle, &center, SDL_FLIP_NONE);
+    for (int i = 0; i < snapshot->num_props; ++i) {
+      display_prop(&snapshot->props[i], &sprite_batch, sim_alpha);
     }
+    PROFILE_END();
 
-    if (dot) {
-      int num_dots = 17;
-      SDL_FPoint center = {dot->w/2 + rand_minus_one_to_one(), dot->h/2 + rand_minus_one_to_one()};
-      dot_shift += 300 * dt_for_previous_frame;
-      f32 spacing = 100;
-      dot_shift = dot_shift > spacing ? 0.0 : dot_shift;
-      for (int i = 0; i < num_dots; i++) {
-        SDL_FRect dest_rect = { -dot_shift + i*spacing - center.x, 944 - center.y, dot->w, dot->h};
-        SDL_RenderTexture(renderer, dot, NULL, &dest_rect);
-      }
-
-      for (int i = 0; i < num_dots; i++) {
-        SDL_FRect dest_rect = { dot_shift + (i-1)*spacing - center.x, 1032 - center.y, dot->w, dot->h};
-        SDL_RenderTexture(renderer, dot, NULL, &dest_rect);
+    if (boss_phase) {
+      SpriteSheet *boss = residency_use(&residency, snapshot->face_animation == 2 ? boss_loose_handle : boss_neutral_handle);
+      if (boss) {
+        sprite_batch_draw(&sprite_batch, LAYER_BOSS, 0, &boss->frames[0], &(SDL_FRect){0, -60, 1920, 1200});
       }
     }
 
-
-    if (belt) {
-      SDL_RenderTexture(renderer, belt, NULL, &(SDL_FRect){0, 0, belt->w, belt->h});
+    PROFILE_SCOPE("end frame") sprite_batch_end_frame(&sprite_batch);
+    profiler_draw_overlay(renderer);
+    if (headless.enabled && !headless_end_frame(&headless, renderer)) quit = true;
+    //NOTE: Flushing first makes a software renderer's drawing count, the
+    // vsync wait in SDL_RenderPresent() must not.
+    if (sprite_batch.dynres && dynres.adaptive) {
+      SDL_FlushRenderer(renderer);
+      dynamic_res_update(&dynres, (SDL_GetPerformanceCounter() - time_stamp_now) * 1000.0 / SDL_GetPerformanceFrequency());
     }
-    else {
-      SDL_SetRenderDrawColor(renderer, 0, 0, 255, 255);
-      SDL_RenderFillRect(renderer, &(SDL_FRect){0, 890, 1920, 205});
+    u64 present_start = SDL_GetTicksNS();
+    PROFILE_SCOPE("present") SDL_RenderPresent(renderer);
+    latency_presented(&latency, present_start, SDL_GetTicksNS());
+    if (!headless.enabled) frame_pacer_wait(&pacer);
+    if (bench_frames) frame_bench_frame(&frame_bench, sprite_batch.frame_draw_calls);
+
+    if (first_frame) {
+      first_frame = false;
+      SDL_Log("time to first frame: %.3f ms", (SDL_GetPerformanceCounter() - time_stamp_startup) * 1000.0 / SDL_GetPerformanceFrequency());
+      sprite_batch_report(&sprite_batch);
     }
-
-    // last z, end of z, end of order
-
-    SDL_RenderPresent(renderer);
   }
 
-  SDL_DestroyTexture(cat_ani.spr_tex);
-  SDL_DestroyTexture(bg_tex);
-  SDL_DestroyTexture(spawn);
-  SDL_DestroyTexture(belt);
-  SDL_DestroyTexture(wheels);
+  simulation_stop_thread(&sim);
+  if (latency.measure || latency.low_latency) latency_report(&latency);
+  if (!headless.enabled) frame_pacer_report(&pacer);
+  b8 headless_ok = !headless.enabled || headless_finish(&headless);
+  b8 bench_ok = !bench_frames || frame_bench_finish(&frame_bench, renderer_name);
+
+  TexHandle owned_handles[] = {
+    cat_tail_handle, cat_face_handle, cat_body_handle,
+    spawn_handle, spawn_bg_handle, belt_handle, wheels_handle, dot_handle,
+  };
+  for (int i = 0; i < LEN(owned_handles); ++i) asset_loader_release(&asset_loader, owned_handles[i]);
+  for (int i = 0; i < NUM_TYPES; ++i) asset_loader_release(&asset_loader, prop_handles[i]);
+  atlas_destroy(&atlas, &resources);
+  layer_cache_destroy(&bg_cache, &resources);
+  if (sprite_batch.dirty) dirty_destroy(&dirty_tracker, &resources);
+  if (sprite_batch.dynres) dynamic_res_destroy(&dynres, &resources);
+  if (sprite_batch.raster) soft_raster_destroy(&soft_raster, &resources);
+  sprite_batch_destroy(&sprite_batch);
+
+  residency_report(&residency);
+  residency_shutdown(&residency);
+  asset_loader_shutdown(&asset_loader);
+  asset_pack_close(&asset_pack);
+  resources_shutdown(&resources);
+
+  if (trace_path) profiler_write_trace(trace_path);
+  profiler_shutdown();
 
   SDL_DestroyRenderer(renderer);
   SDL_DestroyWindow(main_window);
   SDL_Quit();
-  return 0;
+  return bench_ok && headless_ok ? 0 : 1;
 }
@@ -0,0 +1,399 @@
+// Per-pixel kernels that run over whole images at load time. Each kernel
+// has a scalar version plus SSE2/NEON (some also AVX2) versions picked at
+// runtime, all of them read RGBA32 rows.
+
+#include <SDL_intrin.h>
+
+// out[x] = rounded average of the 2x2 block at (2x, 0) in row0/row1.
+static void downsample_2x_row_scalar(const u8 *row0, const u8 *row1, u8 *out, int out_w) {
+  for (int x = 0; x < out_w; ++x) {
+    const u8 *a = row0 + x*8;
+    const u8 *b = row1 + x*8;
+    for (int c = 0; c < 4; ++c)
+      out[x*4 + c] = (u8)((a[c] + a[c + 4] + b[c] + b[c + 4] + 2) >> 2);
+  }
+}
+
+#ifdef SDL_SSE2_INTRINSICS
+static void SDL_TARGETING("sse2") downsample_2x_row_sse2(const u8 *row0, const u8 *row1, u8 *out, int out_w) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i two  = _mm_set1_epi16(2);
+
+  int x = 0;
+  for (; x + 2 <= out_w; x += 2) {
+    __m128i a = _mm_loadu_si128((const __m128i *)(row0 + x*8));
+    __m128i b = _mm_loadu_si128((const __m128i *)(row1 + x*8));
+
+    // 16 bit lanes: lo holds source pixels 0,1 and hi pixels 2,3.
+    __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+    __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+    lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+    hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+
+    __m128i sum = _mm_unpacklo_epi64(lo, hi);
+    sum = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+    _mm_storel_epi64((__m128i *)(out + x*4), _mm_packus_epi16(sum, zero));
+  }
+
+  downsample_2x_row_scalar(row0 + x*8, row1 + x*8, out + x*4, out_w - x);
+}
+#endif
+
+#ifdef SDL_NEON_INTRINSICS
+static void downsample_2x_row_neon(const u8 *row0, const u8 *row1, u8 *out, int out_w) {
+  int x = 0;
+  for (; x + 2 <= out_w; x += 2) {
+    uint8x16_t a = vld1q_u8(row0 + x*8);
+    uint8x16_t b = vld1q_u8(row1 + x*8);
+
+    uint16x8_t lo = vaddl_u8(vget_low_u8(a), vget_low_u8(b));
+    uint16x8_t hi = vaddl_u8(vget_high_u8(a), vget_high_u8(b));
+    uint16x4_t p0 = vadd_u16(vget_low_u16(lo), vget_high_u16(lo));
+    uint16x4_t p1 = vadd_u16(vget_low_u16(hi), vget_high_u16(hi));
+
+    vst1_u8(out + x*4, vrshrn_n_u16(vcombine_u16(p0, p1), 2));
+  }
+
+  downsample_2x_row_scalar(row0 + x*8, row1 + x*8, out + x*4, out_w - x);
+}
+#endif
+
+typedef void (*DownsampleRowFn)(const u8 *row0, const u8 *row1, u8 *out, int out_w);
+
+static DownsampleRowFn pick_downsample_row(void) {
+#ifdef SDL_SSE2_INTRINSICS
+  if (SDL_HasSSE2()) return downsample_2x_row_sse2;
+#endif
+#ifdef SDL_NEON_INTRINSICS
+  if (SDL_HasNEON()) return downsample_2x_row_neon;
+#endif
+  return downsample_2x_row_scalar;
+}
+
+// 2x2 box filter. A trailing odd row/column is dropped, callers that care
+// (mip chains) keep their images at even sizes.
+b8 image_downsample_2x(Image *src, Image *dst) {
+  dst->width  = MAX(src->width / 2, 1);
+  dst->height = MAX(src->height / 2, 1);
+  dst->pitch  = dst->width * 4;
+  dst->pixels = SDL_malloc((size_t)dst->pitch * dst->height);
+  if (!dst->pixels) return false;
+
+  if (src->width < 2 || src->height < 2) {
+    for (int y = 0; y < dst->height; ++y)
+      SDL_memcpy(dst->pixels + (size_t)y * dst->pitch, src->pixels + (size_t)y * src->pitch, (size_t)dst->pitch);
+    return true;
+  }
+
+  DownsampleRowFn downsample_row = pick_downsample_row();
+  for (int y = 0; y < dst->height; ++y) {
+    const u8 *row0 = src->pixels + (size_t)(2*y) * src->pitch;
+    downsample_row(row0, row0 + src->pitch, dst->pixels + (size_t)y * dst->pitch, dst->width);
+  }
+  return true;
+}
+
+// Alpha classification. ALPHA_OPAQUE < ALPHA_BINARY < ALPHA_BLENDED, so the
+// class of an image is the largest class of its rows.
+static int alpha_class_row_scalar(const u8 *row, int width) {
+  int result = ALPHA_OPAQUE;
+  for (int x = 0; x < width; ++x) {
+    u8 alpha = row[x*4 + 3];
+    if (alpha == 255) continue;
+    if (alpha != 0) return ALPHA_BLENDED;
+    result = ALPHA_BINARY;
+  }
+  return result;
+}
+
+#ifdef SDL_SSE2_INTRINSICS
+static int SDL_TARGETING("sse2") alpha_class_row_sse2(const u8 *row, int width) {
+  const __m128i alpha_mask = _mm_set1_epi32((int)0xff000000);
+  const __m128i zero = _mm_setzero_si128();
+  __m128i all_opaque = _mm_set1_epi32(-1);
+  __m128i all_binary = _mm_set1_epi32(-1);
+
+  int x = 0;
+  for (; x + 4 <= width; x += 4) {
+    __m128i alpha  = _mm_and_si128(_mm_loadu_si128((const __m128i *)(row + x*4)), alpha_mask);
+    __m128i opaque = _mm_cmpeq_epi32(alpha, alpha_mask);
+    all_opaque = _mm_and_si128(all_opaque, opaque);
+    all_binary = _mm_and_si128(all_binary, _mm_or_si128(opaque, _mm_cmpeq_epi32(alpha, zero)));
+  }
+
+  if (_mm_movemask_epi8(all_binary) != 0xffff) return ALPHA_BLENDED;
+  int result = _mm_movemask_epi8(all_opaque) == 0xffff ? ALPHA_OPAQUE : ALPHA_BINARY;
+  int tail = alpha_class_row_scalar(row + x*4, width - x);
+  return tail > result ? tail : result;
+}
+#endif
+
+#ifdef SDL_NEON_INTRINSICS
+static int alpha_class_row_neon(const u8 *row, int width) {
+  const uint8x16_t opaque_alpha = vdupq_n_u8(255);
+  const uint8x16_t clear_alpha  = vdupq_n_u8(0);
+  uint8x16_t all_opaque = opaque_alpha;
+  uint8x16_t all_binary = opaque_alpha;
+
+  int x = 0;
+  for (; x + 16 <= width; x += 16) {
+    uint8x16_t alpha  = vld4q_u8(row + x*4).val[3];
+    uint8x16_t opaque = vceqq_u8(alpha, opaque_alpha);
+    all_opaque = vandq_u8(all_opaque, opaque);
+    all_binary = vandq_u8(all_binary, vorrq_u8(opaque, vceqq_u8(alpha, clear_alpha)));
+  }
+
+  uint64x2_t binary = vreinterpretq_u64_u8(all_binary);
+  uint64x2_t opaque = vreinterpretq_u64_u8(all_opaque);
+  if ((vgetq_lane_u64(binary, 0) & vgetq_lane_u64(binary, 1)) != ~0ull) return ALPHA_BLENDED;
+  int result = (vgetq_lane_u64(opaque, 0) & vgetq_lane_u64(opaque, 1)) == ~0ull ? ALPHA_OPAQUE : ALPHA_BINARY;
+  int tail = alpha_class_row_scalar(row + x*4, width - x);
+  return tail > result ? tail : result;
+}
+#endif
+
+typedef int (*AlphaClassRowFn)(const u8 *row, int width);
+
+static AlphaClassRowFn pick_alpha_class_row(void) {
+#ifdef SDL_SSE2_INTRINSICS
+  if (SDL_HasSSE2()) return alpha_class_row_sse2;
+#endif
+#ifdef SDL_NEON_INTRINSICS
+  if (SDL_HasNEON()) return alpha_class_row_neon;
+#endif
+  return alpha_class_row_scalar;
+}
+
+// Stops at the first row with partial alpha, so translucent art costs next
+// to nothing and only opaque/cutout art is read in full.
+enum AlphaClass image_alpha_class(Image *image) {
+  AlphaClassRowFn alpha_class_row = pick_alpha_class_row();
+  int result = ALPHA_OPAQUE;
+  for (int y = 0; y < image->height && result != ALPHA_BLENDED; ++y) {
+    int row = alpha_class_row(image->pixels + (size_t)y * image->pitch, image->width);
+    result = row > result ? row : result;
+  }
+  return (enum AlphaClass)result;
+}
+
+// Opaque art drops its alpha channel: XRGB8888 keeps full color and matches
+// the usual window format, RGB565 halves the memory for the low quality tier.
+static void convert_row_xrgb8888_scalar(const u8 *src, u8 *dst, int width) {
+  for (int x = 0; x < width; ++x) {
+    const u8 *p = src + x*4;
+    u32 out = 0xff000000u | (u32)p[0] << 16 | (u32)p[1] << 8 | p[2];
+    SDL_memcpy(dst + x*4, &out, 4);
+  }
+}
+
+static void convert_row_rgb565_scalar(const u8 *src, u8 *dst, int width) {
+  for (int x = 0; x < width; ++x) {
+    const u8 *p = src + x*4;
+    u16 out = (u16)((p[0] >> 3) << 11 | (p[1] >> 2) << 5 | p[2] >> 3);
+    SDL_memcpy(dst + x*2, &out, 2);
+  }
+}
+
+#ifdef SDL_SSE2_INTRINSICS
+// RGBA32 is ABGR8888 on x86, so going to XRGB8888 swaps the R and B bytes.
+static void SDL_TARGETING("sse2") convert_row_xrgb8888_sse2(const u8 *src, u8 *dst, int width) {
+  const __m128i keep_g = _mm_set1_epi32(0x0000ff00);
+  const __m128i low    = _mm_set1_epi32(0x000000ff);
+  const __m128i x_bits = _mm_set1_epi32((int)0xff000000);
+
+  int x = 0;
+  for (; x + 4 <= width; x += 4) {
+    __m128i p = _mm_loadu_si128((const __m128i *)(src + x*4));
+    __m128i r = _mm_slli_epi32(_mm_and_si128(p, low), 16);
+    __m128i b = _mm_and_si128(_mm_srli_epi32(p, 16), low);
+    __m128i out = _mm_or_si128(_mm_or_si128(_mm_and_si128(p, keep_g), x_bits), _mm_or_si128(r, b));
+    _mm_storeu_si128((__m128i *)(dst + x*4), out);
+  }
+
+  convert_row_xrgb8888_scalar(src + x*4, dst + x*4, width - x);
+}
+
+static void SDL_TARGETING("sse2") convert_row_rgb565_sse2(const u8 *src, u8 *dst, int width) {
+  const __m128i r_mask = _mm_set1_epi32(0x000000f8);
+  const __m128i g_mask = _mm_set1_epi32(0x0000fc00);
+  const __m128i b_mask = _mm_set1_epi32(0x00f80000);
+  const __m128i bias32 = _mm_set1_epi32(0x8000);
+  const __m128i bias16 = _mm_set1_epi16((short)0x8000);
+
+  int x = 0;
+  for (; x + 8 <= width; x += 8) {
+    __m128i out[2];
+    for (int half = 0; half < 2; ++half) {
+      __m128i p = _mm_loadu_si128((const __m128i *)(src + (x + half*4)*4));
+      __m128i r = _mm_slli_epi32(_mm_and_si128(p, r_mask), 8);
+      __m128i g = _mm_srli_epi32(_mm_and_si128(p, g_mask), 5);
+      __m128i b = _mm_srli_epi32(_mm_and_si128(p, b_mask), 19);
+      // Biased so the signed saturating pack keeps all 16 bits.
+      out[half] = _mm_sub_epi32(_mm_or_si128(_mm_or_si128(r, g), b), bias32);
+    }
+    __m128i packed = _mm_add_epi16(_mm_packs_epi32(out[0], out[1]), bias16);
+    _mm_storeu_si128((__m128i *)(dst + x*2), packed);
+  }
+
+  convert_row_rgb565_scalar(src + x*4, dst + x*2, width - x);
+}
+#endif
+
+#ifdef SDL_NEON_INTRINSICS
+static void convert_row_xrgb8888_neon(const u8 *src, u8 *dst, int width) {
+  int x = 0;
+  for (; x + 16 <= width; x += 16) {
+    uint8x16x4_t p = vld4q_u8(src + x*4);
+    uint8x16x4_t out = { { p.val[2], p.val[1], p.val[0], vdupq_n_u8(255) } };
+    vst4q_u8(dst + x*4, out);
+  }
+
+  convert_row_xrgb8888_scalar(src + x*4, dst + x*4, width - x);
+}
+
+static void convert_row_rgb565_neon(const u8 *src, u8 *dst, int width) {
+  int x = 0;
+  for (; x + 8 <= width; x += 8) {
+    uint8x8x4_t p = vld4_u8(src + x*4);
+    uint16x8_t out = vshll_n_u8(p.val[0], 8);
+    out = vsriq_n_u16(out, vshll_n_u8(p.val[1], 8), 5);
+    out = vsriq_n_u16(out, vshll_n_u8(p.val[2], 8), 11);
+    vst1q_u16((u16 *)(dst + x*2), out);
+  }
+
+  convert_row_rgb565_scalar(src + x*4, dst + x*2, width - x);
+}
+#endif
+
+typedef void (*ConvertRowFn)(const u8 *src, u8 *dst, int width);
+
+static ConvertRowFn pick_convert_row(SDL_PixelFormat format) {
+  b8 rgb565 = format == SDL_PIXELFORMAT_RGB565;
+#ifdef SDL_SSE2_INTRINSICS
+  if (SDL_HasSSE2()) return rgb565 ? convert_row_rgb565_sse2 : convert_row_xrgb8888_sse2;
+#endif
+#ifdef SDL_NEON_INTRINSICS
+  if (SDL_HasNEON()) return rgb565 ? convert_row_rgb565_neon : convert_row_xrgb8888_neon;
+#endif
+  return rgb565 ? convert_row_rgb565_scalar : convert_row_xrgb8888_scalar;
+}
+
+// format is SDL_PIXELFORMAT_XRGB8888 or SDL_PIXELFORMAT_RGB565. The alpha of
+// src is ignored, callers check image_alpha_class() first.
+b8 image_convert_opaque(Image *src, Image *dst, SDL_PixelFormat format) {
+  dst->width  = src->width;
+  dst->height = src->height;
+  dst->pitch  = src->width * SDL_BYTESPERPIXEL(format);
+  dst->pixels = SDL_malloc((size_t)dst->pitch * dst->height);
+  if (!dst->pixels) return false;
+
+  ConvertRowFn convert_row = pick_convert_row(format);
+  for (int y = 0; y < src->height; ++y)
+    convert_row(src->pixels + (size_t)y * src->pitch, dst->pixels + (size_t)y * dst->pitch, src->width);
+  return true;
+}
+
+// Premultiplied alpha: rgb = rgb * a / 255, rounded. Filtering and box
+// downsampling premultiplied pixels does not pull the color of transparent
+// neighbours into the edges, which is where the dark fringes came from.
+static void premultiply_row_scalar(const u8 *src, u8 *dst, int width) {
+  for (int x = 0; x < width; ++x) {
+    const u8 *p = src + x*4;
+    u8 *out = dst + x*4;
+    u32 alpha = p[3];
+    for (int c = 0; c < 3; ++c) {
+      u32 t = p[c] * alpha + 128;
+      out[c] = (u8)((t + (t >> 8)) >> 8);
+    }
+    out[3] = (u8)alpha;
+  }
+}
+
+#ifdef SDL_SSE2_INTRINSICS
+static void SDL_TARGETING("sse2") premultiply_row_sse2(const u8 *src, u8 *dst, int width) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i half = _mm_set1_epi16(128);
+  const __m128i alpha_mask = _mm_set1_epi32((int)0xff000000);
+
+  int x = 0;
+  for (; x + 4 <= width; x += 4) {
+    __m128i p = _mm_loadu_si128((const __m128i *)(src + x*4));
+    __m128i channels[2] = { _mm_unpacklo_epi8(p, zero), _mm_unpackhi_epi8(p, zero) };
+    for (int i = 0; i < 2; ++i) {
+      __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(channels[i], 0xff), 0xff);
+      __m128i t = _mm_add_epi16(_mm_mullo_epi16(channels[i], alpha), half);
+      channels[i] = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+    }
+    __m128i out = _mm_packus_epi16(channels[0], channels[1]);
+    out = _mm_or_si128(_mm_andnot_si128(alpha_mask, out), _mm_and_si128(alpha_mask, p));
+    _mm_storeu_si128((__m128i *)(dst + x*4), out);
+  }
+
+  premultiply_row_scalar(src + x*4, dst + x*4, width - x);
+}
+#endif
+
+#ifdef SDL_AVX2_INTRINSICS
+// Same as the SSE2 version on 8 pixels. Unpack and pack both work per
+// 128 bit lane, so the pixel order survives the round trip.
+static void SDL_TARGETING("avx2") premultiply_row_avx2(const u8 *src, u8 *dst, int width) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i half = _mm256_set1_epi16(128);
+  const __m256i alpha_mask = _mm256_set1_epi32((int)0xff000000);
+
+  int x = 0;
+  for (; x + 8 <= width; x += 8) {
+    __m256i p = _mm256_loadu_si256((const __m256i *)(src + x*4));
+    __m256i channels[2] = { _mm256_unpacklo_epi8(p, zero), _mm256_unpackhi_epi8(p, zero) };
+    for (int i = 0; i < 2; ++i) {
+      __m256i alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(channels[i], 0xff), 0xff);
+      __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(channels[i], alpha), half);
+      channels[i] = _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+    }
+    __m256i out = _mm256_packus_epi16(channels[0], channels[1]);
+    out = _mm256_blendv_epi8(out, p, alpha_mask);
+    _mm256_storeu_si256((__m256i *)(dst + x*4), out);
+  }
+
+  premultiply_row_scalar(src + x*4, dst + x*4, width - x);
+}
+#endif
+
+#ifdef SDL_NEON_INTRINSICS
+static void premultiply_row_neon(const u8 *src, u8 *dst, int width) {
+  int x = 0;
+  for (; x + 8 <= width; x += 8) {
+    uint8x8x4_t p = vld4_u8(src + x*4);
+    for (int c = 0; c < 3; ++c) {
+      // (t + ((t + 128) >> 8) + 128) >> 8, the scalar rounding exactly.
+      uint16x8_t t = vmull_u8(p.val[c], p.val[3]);
+      p.val[c] = vraddhn_u16(t, vrshrq_n_u16(t, 8));
+    }
+    vst4_u8(dst + x*4, p);
+  }
+
+  premultiply_row_scalar(src + x*4, dst + x*4, width - x);
+}
+#endif
+
+typedef void (*PremultiplyRowFn)(const u8 *src, u8 *dst, int width);
+
+static PremultiplyRowFn pick_premultiply_row(void) {
+#ifdef SDL_AVX2_INTRINSICS
+  if (SDL_HasAVX2()) return premultiply_row_avx2;
+#endif
+#ifdef SDL_SSE2_INTRINSICS
+  if (SDL_HasSSE2()) return premultiply_row_sse2;
+#endif
+#ifdef SDL_NEON_INTRINSICS
+  if (SDL_HasNEON()) return premultiply_row_neon;
+#endif
+  return premultiply_row_scalar;
+}
+
+// src and dst may be the same image.
+void image_premultiply_alpha(Image *src, Image *dst) {
+  PremultiplyRowFn premultiply_row = pick_premultiply_row();
+  for (int y = 0; y < src->height; ++y)
+    premultiply_row(src->pixels + (size_t)y * src->pitch, dst->pixels + (size_t)y * dst->pitch, src->width);
+}
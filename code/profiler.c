@@ -0,0 +1,291 @@
+// Scoped CPU profiler. PROFILE_BEGIN("name") / PROFILE_END() around a stretch
+// of code, or PROFILE_SCOPE("name") { ... } around a block, record one event
+// with SDL_GetPerformanceCounter() start and end. Names must be string
+// literals (they are stored as pointers) and scopes nest. A break or return
+// out of a PROFILE_SCOPE block skips its end.
+//
+// Every thread writes into its own ring buffer, found through SDL TLS, so
+// recording takes no lock. Readers (the trace export) copy the ring and drop
+// whatever the writer lapped while they copied. The main thread calls
+// profiler_frame() once per frame, which feeds the overlay: smoothed times of
+// the frame's stages plus a graph of the last frame times.
+//
+// Built with NDEBUG (make release) every macro compiles to nothing and the
+// functions are empty.
+
+#ifndef NDEBUG
+#define PROFILER_ENABLED
+#endif
+
+#ifdef PROFILER_ENABLED
+
+#define PROFILE_RING_SIZE    8192 // events per thread, a power of two
+#define PROFILE_MAX_THREADS  64
+#define PROFILE_MAX_DEPTH    32
+#define PROFILE_MAX_STAGES   32
+#define PROFILE_GRAPH_FRAMES 240
+
+typedef struct {
+  const char *name;
+  u64 start;
+  u64 end;
+  u32 depth;
+} ProfileEvent;
+
+typedef struct {
+  ProfileEvent events[PROFILE_RING_SIZE];
+  SDL_AtomicInt head; // events written so far, slot is head % PROFILE_RING_SIZE
+  SDL_ThreadID id;
+  const char *name;
+
+  // Open scopes, only ever touched by the owning thread.
+  int depth;
+  const char *open_names[PROFILE_MAX_DEPTH];
+  u64 open_starts[PROFILE_MAX_DEPTH];
+} ProfileThread;
+
+typedef struct {
+  const char *name;
+  u32 depth;
+  f64 frame_ms;  // this frame
+  f64 smooth_ms; // exponential average over roughly the last 60 frames
+} ProfileStage;
+
+static struct {
+  SDL_TLSID tls;
+  void *threads[PROFILE_MAX_THREADS]; // ProfileThread *, published atomically
+  SDL_AtomicInt num_threads;
+  u64 start;
+
+  // Overlay, main thread only.
+  b8 overlay;
+  ProfileThread *main_thread;
+  u32 frame_head;   // main_thread->head at the last profiler_frame()
+  u64 frame_start;
+  ProfileStage stages[PROFILE_MAX_STAGES];
+  int num_stages;
+  f32 frame_ms[PROFILE_GRAPH_FRAMES];
+  int graph_next;
+  f64 smooth_frame_ms;
+} profiler;
+
+static ProfileThread *profiler_register(const char *name) {
+  int index = SDL_AddAtomicInt(&profiler.num_threads, 1);
+  if (index >= PROFILE_MAX_THREADS) {
+    SDL_AddAtomicInt(&profiler.num_threads, -1);
+    return NULL;
+  }
+  ProfileThread *thread = SDL_calloc(1, sizeof(ProfileThread));
+  if (!thread) return NULL;
+  thread->id = SDL_GetCurrentThreadID();
+  thread->name = name;
+  // Rings outlive their threads, a trace can still show them.
+  SDL_SetTLS(&profiler.tls, thread, NULL);
+  SDL_SetAtomicPointer(&profiler.threads[index], thread);
+  return thread;
+}
+
+// NULL once PROFILE_MAX_THREADS threads took a ring.
+static ProfileThread *profiler_thread(void) {
+  ProfileThread *thread = SDL_GetTLS(&profiler.tls);
+  return thread ? thread : profiler_register(NULL);
+}
+
+static void profiler_begin(const char *name) {
+  ProfileThread *thread = profiler_thread();
+  if (!thread) return;
+  if (thread->depth < PROFILE_MAX_DEPTH) {
+    thread->open_names[thread->depth] = name;
+    thread->open_starts[thread->depth] = SDL_GetPerformanceCounter();
+  }
+  thread->depth++;
+}
+
+static void profiler_end(void) {
+  u64 end = SDL_GetPerformanceCounter();
+  ProfileThread *thread = profiler_thread();
+  if (!thread || thread->depth == 0) return;
+  int depth = --thread->depth;
+  if (depth >= PROFILE_MAX_DEPTH) return;
+
+  u32 head = (u32)SDL_GetAtomicInt(&thread->head);
+  thread->events[head % PROFILE_RING_SIZE] = (ProfileEvent){ thread->open_names[depth], thread->open_starts[depth], end, (u32)depth };
+  // Publishes the event, readers never look past head.
+  SDL_SetAtomicInt(&thread->head, (int)(head + 1));
+}
+
+// First thing in a thread, the name is fixed once the thread has a ring.
+static void profiler_set_thread_name(const char *name) {
+  if (!SDL_GetTLS(&profiler.tls)) profiler_register(name);
+}
+
+// Runs the block once, between profiler_begin() and profiler_end().
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) \
+  for (int PROFILE_CONCAT(profile_once_, __LINE__) = (profiler_begin(name), 1); PROFILE_CONCAT(profile_once_, __LINE__); PROFILE_CONCAT(profile_once_, __LINE__) = (profiler_end(), 0))
+#define PROFILE_BEGIN(name) profiler_begin(name)
+#define PROFILE_END() profiler_end()
+#define PROFILE_THREAD_NAME(name) profiler_set_thread_name(name)
+
+void profiler_init(void) {
+  profiler.start = SDL_GetPerformanceCounter();
+  profiler.frame_start = profiler.start;
+  profiler.main_thread = profiler_register("main");
+}
+
+void profiler_toggle_overlay(void) {
+  profiler.overlay = !profiler.overlay;
+}
+
+static ProfileStage *profiler_stage(const char *name, u32 depth) {
+  for (int i = 0; i < profiler.num_stages; ++i)
+    if (profiler.stages[i].name == name && profiler.stages[i].depth == depth) return &profiler.stages[i];
+  if (profiler.num_stages == PROFILE_MAX_STAGES) return NULL;
+  profiler.stages[profiler.num_stages] = (ProfileStage){ .name = name, .depth = depth };
+  return &profiler.stages[profiler.num_stages++];
+}
+
+// Once per frame on the main thread, between two frames.
+void profiler_frame(void) {
+  u64 now = SDL_GetPerformanceCounter();
+  f64 to_ms = 1000.0 / SDL_GetPerformanceFrequency();
+  f64 frame_ms = (now - profiler.frame_start) * to_ms;
+  profiler.frame_start = now;
+
+  profiler.frame_ms[profiler.graph_next] = (f32)frame_ms;
+  profiler.graph_next = (profiler.graph_next + 1) % PROFILE_GRAPH_FRAMES;
+  profiler.smooth_frame_ms += (frame_ms - profiler.smooth_frame_ms) * 0.05;
+
+  ProfileThread *thread = profiler.main_thread;
+  if (!thread) return;
+  for (int i = 0; i < profiler.num_stages; ++i) profiler.stages[i].frame_ms = 0;
+
+  // Own ring, nothing writes to it while we read.
+  u32 head = (u32)SDL_GetAtomicInt(&thread->head);
+  u32 first = head - profiler.frame_head > PROFILE_RING_SIZE ? head - PROFILE_RING_SIZE : profiler.frame_head;
+  for (u32 i = first; i != head; ++i) {
+    ProfileEvent *event = &thread->events[i % PROFILE_RING_SIZE];
+    if (event->depth > 1) continue;
+    ProfileStage *stage = profiler_stage(event->name, event->depth);
+    if (stage) stage->frame_ms += (event->end - event->start) * to_ms;
+  }
+  profiler.frame_head = head;
+
+  for (int i = 0; i < profiler.num_stages; ++i)
+    profiler.stages[i].smooth_ms += (profiler.stages[i].frame_ms - profiler.stages[i].smooth_ms) * 0.05;
+}
+
+// Stage times and the frame time graph, straight on the render target with
+// SDL's debug font. Call after the frame is drawn, before presenting.
+void profiler_draw_overlay(SDL_Renderer *renderer) {
+  if (!profiler.overlay) return;
+
+  f32 scale_x, scale_y;
+  SDL_GetRenderScale(renderer, &scale_x, &scale_y);
+  SDL_SetRenderScale(renderer, 2.f, 2.f);
+  SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+
+  const f32 line_h = 10.f;
+  const f32 graph_h = 60.f; // 33.3 ms
+  f32 panel_h = (profiler.num_stages + 2) * line_h + graph_h + 12.f;
+  SDL_SetRenderDrawColor(renderer, 0, 0, 0, 180);
+  SDL_RenderFillRect(renderer, &(SDL_FRect){ 4, 4, PROFILE_GRAPH_FRAMES * 1.f + 8, panel_h });
+
+  SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+  f32 y = 8.f;
+  SDL_RenderDebugTextFormat(renderer, 8, y, "frame %6.2f ms  %5.0f fps", profiler.smooth_frame_ms,
+                            profiler.smooth_frame_ms > 0 ? 1000.0 / profiler.smooth_frame_ms : 0.0);
+  y += line_h * 1.5f;
+  for (int i = 0; i < profiler.num_stages; ++i, y += line_h) {
+    ProfileStage *stage = &profiler.stages[i];
+    SDL_RenderDebugTextFormat(renderer, 8 + stage->depth * 16.f, y, "%-18s %6.2f", stage->name, stage->smooth_ms);
+  }
+
+  // One bar per frame, oldest on the left, lines at 16.7 and 33.3 ms.
+  f32 base = y + graph_h;
+  for (int i = 0; i < PROFILE_GRAPH_FRAMES; ++i) {
+    f32 ms = profiler.frame_ms[(profiler.graph_next + i) % PROFILE_GRAPH_FRAMES];
+    f32 h = SDL_min(ms / 33.3f, 1.f) * graph_h;
+    if (ms > 16.7f) SDL_SetRenderDrawColor(renderer, 255, 80, 80, 255);
+    else SDL_SetRenderDrawColor(renderer, 80, 255, 80, 255);
+    SDL_RenderLine(renderer, 8 + i, base, 8 + i, base - h);
+  }
+  SDL_SetRenderDrawColor(renderer, 255, 255, 255, 120);
+  SDL_RenderLine(renderer, 8, base - graph_h * 0.5f, 8 + PROFILE_GRAPH_FRAMES, base - graph_h * 0.5f);
+  SDL_RenderLine(renderer, 8, base - graph_h, 8 + PROFILE_GRAPH_FRAMES, base - graph_h);
+
+  SDL_SetRenderScale(renderer, scale_x, scale_y);
+}
+
+// Everything still in the rings as Chrome trace JSON (chrome://tracing,
+// ui.perfetto.dev), one complete event per scope.
+b8 profiler_write_trace(const char *path) {
+  SDL_IOStream *out = SDL_IOFromFile(path, "w");
+  if (!out) {
+    SDL_Log("Could not write trace %s: %s", path, SDL_GetError());
+    return false;
+  }
+
+  static ProfileEvent events[PROFILE_RING_SIZE];
+  f64 to_us = 1000000.0 / SDL_GetPerformanceFrequency();
+  int num_written = 0;
+  SDL_IOprintf(out, "{\"traceEvents\":[\n");
+
+  int num_threads = SDL_min(SDL_GetAtomicInt(&profiler.num_threads), PROFILE_MAX_THREADS);
+  for (int t = 0; t < num_threads; ++t) {
+    ProfileThread *thread = SDL_GetAtomicPointer(&profiler.threads[t]);
+    if (!thread) continue;
+
+    // Copy, then drop what the writer overwrote in the meantime.
+    u32 head = (u32)SDL_GetAtomicInt(&thread->head);
+    u32 first = head > PROFILE_RING_SIZE ? head - PROFILE_RING_SIZE : 0;
+    for (u32 i = first; i != head; ++i) events[i - first] = thread->events[i % PROFILE_RING_SIZE];
+    u32 head_after = (u32)SDL_GetAtomicInt(&thread->head);
+    u32 valid_from = head_after > PROFILE_RING_SIZE ? head_after - PROFILE_RING_SIZE : 0;
+    if (valid_from < first) valid_from = first;
+
+    SDL_IOprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%" SDL_PRIu64 ",\"args\":{\"name\":\"%s\"}}",
+                 num_written++ ? ",\n" : "", thread->id, thread->name ? thread->name : "thread");
+    for (u32 i = valid_from; i != head; ++i) {
+      ProfileEvent *event = &events[i - first];
+      if (event->start < profiler.start) continue;
+      SDL_IOprintf(out, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%" SDL_PRIu64 ",\"ts\":%.3f,\"dur\":%.3f}",
+                   event->name, thread->id, (event->start - profiler.start) * to_us, (event->end - event->start) * to_us);
+      num_written++;
+    }
+  }
+
+  SDL_IOprintf(out, "\n]}\n");
+  b8 ok = SDL_CloseIO(out);
+  if (ok) SDL_Log("profiler: %d events written to %s", num_written, path);
+  return ok;
+}
+
+// After every thread that recorded has finished.
+void profiler_shutdown(void) {
+  SDL_SetTLS(&profiler.tls, NULL, NULL);
+  profiler.main_thread = NULL;
+  int num_threads = SDL_min(SDL_GetAtomicInt(&profiler.num_threads), PROFILE_MAX_THREADS);
+  for (int t = 0; t < num_threads; ++t) {
+    SDL_free(SDL_GetAtomicPointer(&profiler.threads[t]));
+    SDL_SetAtomicPointer(&profiler.threads[t], NULL);
+  }
+  SDL_SetAtomicInt(&profiler.num_threads, 0);
+}
+
+#else
+
+#define PROFILE_SCOPE(name)
+#define PROFILE_BEGIN(name)
+#define PROFILE_END()
+#define PROFILE_THREAD_NAME(name)
+
+void profiler_init(void) {}
+void profiler_toggle_overlay(void) {}
+void profiler_frame(void) {}
+void profiler_draw_overlay(SDL_Renderer *renderer) { (void)renderer; }
+b8 profiler_write_trace(const char *path) { (void)path; SDL_Log("Built without the profiler"); return false; }
+void profiler_shutdown(void) {}
+
+#endif
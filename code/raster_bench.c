@@ -0,0 +1,241 @@
+// Throughput of the soft raster against SDL's own software renderer, run
+// with --bench-raster. Both draw the same scenes from the baked pack into a
+// surface without a window: SDL with one SDL_RenderTexture(Rotated) per
+// sprite, the soft raster through the sprite batch. First every kernel
+// variant the CPU supports on one thread at 1080p, then the best kernels on
+// more and more threads at 1080p and at 4K (the scenes scaled up 2x). The
+// best of a few runs counts, and every variant and thread count has to
+// produce the same pixels as scalar on one thread.
+
+#define RASTER_BENCH_RUNS       5
+#define RASTER_BENCH_FRAMES     20
+#define RASTER_BENCH_MAX_SPRITES 16
+
+typedef struct {
+  const char *name;
+  int count;
+  Sprite sprites[RASTER_BENCH_MAX_SPRITES];
+  SDL_FRect dst[RASTER_BENCH_MAX_SPRITES];
+  f32 spin; // degrees per frame, 0 draws unrotated
+} RasterBenchScene;
+
+static RasterBenchScene raster_bench_scaled(RasterBenchScene *scene, f32 scale) {
+  RasterBenchScene scaled = *scene;
+  for (int i = 0; i < scaled.count; ++i)
+    scaled.dst[i] = (SDL_FRect){ scaled.dst[i].x * scale, scaled.dst[i].y * scale, scaled.dst[i].w * scale, scaled.dst[i].h * scale };
+  return scaled;
+}
+
+static void raster_bench_add(RasterBenchScene *scene, Sprite sprite, SDL_FRect dst) {
+  if (!sprite.texture || scene->count == RASTER_BENCH_MAX_SPRITES) return;
+  scene->sprites[scene->count] = sprite;
+  scene->dst[scene->count++] = dst;
+}
+
+static void raster_bench_draw(RasterBenchScene *scene, SDL_Renderer *renderer, SpriteBatch *batch, int frame) {
+  for (int i = 0; i < scene->count; ++i) {
+    Sprite *sprite = &scene->sprites[i];
+    SDL_FRect *dst = &scene->dst[i];
+    f64 angle = scene->spin * (frame + i);
+    SDL_FPoint center = { dst->w * 0.5f, dst->h * 0.5f };
+
+    if (batch && scene->spin != 0) sprite_batch_draw_rotated(batch, 0, (f32)i, sprite, dst, angle, &center);
+    else if (batch) sprite_batch_draw(batch, 0, (f32)i, sprite, dst);
+    else if (scene->spin != 0) draw_sprite_rotated(renderer, sprite, dst, angle, &center);
+    else draw_sprite(renderer, sprite, dst);
+  }
+
+  if (batch) sprite_batch_flush(batch);
+  else SDL_FlushRenderer(renderer);
+}
+
+// Best milliseconds per frame. batch NULL draws with SDL.
+static f64 raster_bench_scene(RasterBenchScene *scene, SDL_Renderer *renderer, SpriteBatch *batch) {
+  f64 best_ms = 0;
+  for (int run = 0; run < RASTER_BENCH_RUNS; ++run) {
+    u64 start = SDL_GetPerformanceCounter();
+    for (int frame = 0; frame < RASTER_BENCH_FRAMES; ++frame) raster_bench_draw(scene, renderer, batch, frame);
+    f64 ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency() / RASTER_BENCH_FRAMES;
+    if (run == 0 || ms < best_ms) best_ms = ms;
+  }
+  return best_ms;
+}
+
+b8 raster_bench_run(AssetPack *pack) {
+  if (!pack->header) {
+    SDL_Log("raster bench needs the baked pack (make pack)");
+    return false;
+  }
+
+  // Big enough for the 4K runs, the 1080p ones use the top left quarter.
+  SDL_Surface *surface = SDL_CreateSurface(3840, 2160, SDL_PIXELFORMAT_XRGB8888);
+  SDL_Renderer *renderer = surface ? SDL_CreateSoftwareRenderer(surface) : NULL;
+  if (!renderer) {
+    SDL_Log("raster bench: no software renderer: %s", SDL_GetError());
+    SDL_DestroySurface(surface);
+    return false;
+  }
+
+  ResourceRegistry resources = {0};
+  static SoftRaster raster;
+  static SpriteBatch batch;
+  AssetLoader loader;
+  if (!soft_raster_init(&raster, renderer, &resources, 3840, 2160, 0) || !asset_loader_init(&loader, renderer, pack, NULL, &resources)) {
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroySurface(surface);
+    return false;
+  }
+  sprite_batch_init(&batch, renderer);
+  sprite_batch_use_soft_raster(&batch, &raster);
+
+  // Same art and load parameters as the game.
+  LoadParams cat_params = { .cols = 3, .rows = 1, .cell_w = 1000, .cell_h = 1000, .display_dims = { .x = 356., .y = 356. } };
+  LoadParams prop_params = { .cols = 2, .rows = 1 };
+  const char *prop_names[] = { "item_duck.png", "item_vase.png", "item_lamp.png", "item_computer.png", "item_bear.png" };
+  TexHandle handles[16];
+  int num_handles = 0;
+  handles[num_handles++] = asset_loader_request(&loader, "background_nolight1.png", LOAD_DEFAULT);
+  handles[num_handles++] = asset_loader_request(&loader, "conveyorbelt_interior.png", LOAD_DEFAULT);
+  handles[num_handles++] = asset_loader_request(&loader, "conveyorbelt_static1.png", LOAD_DEFAULT);
+  handles[num_handles++] = asset_loader_request(&loader, "conveyorbelt_frontwheel1.png", LOAD_DEFAULT);
+  handles[num_handles++] = asset_loader_request(&loader, "conveyorbelt_circle1.png", LOAD_DEFAULT);
+  handles[num_handles++] = asset_loader_request_ex(&loader, "cat_animation_tail.png", &cat_params);
+  handles[num_handles++] = asset_loader_request_ex(&loader, "cat_animation_body.png", &cat_params);
+  handles[num_handles++] = asset_loader_request_ex(&loader, "cat_animation_face.png", &cat_params);
+  for (int i = 0; i < LEN(prop_names); ++i) handles[num_handles++] = asset_loader_request_ex(&loader, prop_names[i], &prop_params);
+  asset_loader_wait_all(&loader);
+
+  RasterBenchScene scenes[4] = {
+    { .name = "opaque copy" }, { .name = "unscaled blend" }, { .name = "scaled blend" }, { .name = "rotated blend", .spin = 7 },
+  };
+  raster_bench_add(&scenes[0], asset_loader_get_sprite(&loader, handles[0]), (SDL_FRect){ 0, 0, 1920, 1080 });
+  for (int i = 1; i <= 3; ++i) {
+    Sprite sprite = asset_loader_get_sprite(&loader, handles[i]);
+    raster_bench_add(&scenes[1], sprite, (SDL_FRect){ 0, 0, sprite.frame_dims.x, sprite.frame_dims.y });
+  }
+  for (int i = 5; i < num_handles; ++i) {
+    SpriteSheet sheet = asset_loader_get_sheet(&loader, handles[i]);
+    v2 size = i < 8 ? (v2){ .x = 356, .y = 356 } : (v2){ .x = sheet.frame_dims.x * 0.8f, .y = sheet.frame_dims.y * 0.8f };
+    raster_bench_add(&scenes[2], sheet.frames[0], (SDL_FRect){ 100 + (i - 5) * 200, 500, size.x, size.y });
+  }
+  f32 wheel_xs[] = { 98, 300, 490, 664, 827, 1026, 1219, 1432 };
+  Sprite wheel = asset_loader_get_sprite(&loader, handles[4]);
+  for (int i = 0; i < LEN(wheel_xs); ++i)
+    raster_bench_add(&scenes[3], wheel, (SDL_FRect){ wheel_xs[i] - wheel.frame_dims.x / 2, 990 - wheel.frame_dims.y / 2, wheel.frame_dims.x, wheel.frame_dims.y });
+
+  RasterKernels variants[RASTER_MAX_KERNEL_VARIANTS];
+  int num_variants = raster_kernel_variants(variants);
+  RasterKernels best = raster.kernels;
+  int max_threads = raster.num_threads;
+  size_t framebuffer_bytes = (size_t)raster.framebuffer->stride * raster.framebuffer->height * 4;
+  u32 *expected[LEN(scenes)][2] = {0};
+  b8 all_match = true;
+
+  // Scalar on one thread is the reference for everything after it.
+#define RASTER_BENCH_CHECK(scene_index, res, is_reference) do {                                             \
+    u32 **reference = &expected[scene_index][res];                                                       \
+    if (is_reference) {                                                                                  \
+      *reference = SDL_malloc(framebuffer_bytes);                                                        \
+      if (*reference) SDL_memcpy(*reference, raster.framebuffer->pixels, framebuffer_bytes);             \
+    }                                                                                                    \
+    match = *reference && SDL_memcmp(*reference, raster.framebuffer->pixels, framebuffer_bytes) == 0;   \
+    all_match = all_match && match;                                                                      \
+  } while (0)
+
+  f64 total_sdl_ms = 0;
+  f64 total_ms[RASTER_MAX_KERNEL_VARIANTS] = {0};
+  soft_raster_set_threads(&raster, 1);
+
+  SDL_Log("raster at 1080p, 1 thread, best of %d runs of %d frames, ms per frame", RASTER_BENCH_RUNS, RASTER_BENCH_FRAMES);
+  for (int s = 0; s < LEN(scenes); ++s) {
+    RasterBenchScene *scene = &scenes[s];
+    raster.num_pixels = 0;
+    raster_bench_draw(scene, renderer, &batch, 0);
+    u64 pixels = raster.num_pixels;
+
+    f64 sdl_ms = raster_bench_scene(scene, renderer, NULL);
+    total_sdl_ms += sdl_ms;
+
+    char line[256];
+    int len = SDL_snprintf(line, sizeof(line), "  %-14s %2d sprites %5.2f Mpix  sdl %7.3f",
+                           scene->name, scene->count, pixels / 1e6, sdl_ms);
+    for (int v = 0; v < num_variants; ++v) {
+      raster.kernels = variants[v];
+      SDL_memset(raster.framebuffer->pixels, 0, framebuffer_bytes);
+      f64 ms = raster_bench_scene(scene, renderer, &batch);
+      total_ms[v] += ms;
+
+      b8 match;
+      RASTER_BENCH_CHECK(s, 0, v == 0);
+      if (len < (int)sizeof(line))
+        len += SDL_snprintf(line + len, sizeof(line) - len, "  %s %7.3f%s", variants[v].name, ms, match ? "" : " MISMATCH");
+    }
+    SDL_Log("%s", line);
+  }
+
+  SDL_Log("  %-6s %8.3f ms per frame", "sdl", total_sdl_ms);
+  for (int v = 0; v < num_variants; ++v)
+    SDL_Log("  %-6s %8.3f ms per frame, %.2fx sdl", variants[v].name, total_ms[v], total_ms[v] > 0 ? total_sdl_ms / total_ms[v] : 0.0);
+
+  // Thread scaling with the kernels the game uses: 1, 2, 4, ... threads.
+  const char *resolutions[2] = { "1080p", "4K" };
+  for (int res = 0; res < 2; ++res) {
+    f32 scale = res == 0 ? 1.f : 2.f;
+    f64 sdl_ms = 0;
+    f64 single_ms = 0;
+    for (int s = 0; s < LEN(scenes); ++s) {
+      RasterBenchScene scene = raster_bench_scaled(&scenes[s], scale);
+      sdl_ms += raster_bench_scene(&scene, renderer, NULL);
+    }
+    SDL_Log("raster at %s, %s kernels: sdl %.3f ms per frame", resolutions[res], best.name, sdl_ms);
+
+    raster.kernels = best;
+    for (int threads = 1; ; threads = SDL_min(threads * 2, max_threads)) {
+      soft_raster_set_threads(&raster, threads);
+      f64 ms = 0;
+      b8 threads_match = true;
+      for (int s = 0; s < LEN(scenes); ++s) {
+        RasterBenchScene scene = raster_bench_scaled(&scenes[s], scale);
+        SDL_memset(raster.framebuffer->pixels, 0, framebuffer_bytes);
+        ms += raster_bench_scene(&scene, renderer, &batch);
+
+        // The 1080p reference has to be made with scalar kernels on one
+        // thread too, the 4K one is made here.
+        b8 match;
+        if (res == 1 && threads == 1) {
+          raster.kernels = variants[0];
+          SDL_memset(raster.framebuffer->pixels, 0, framebuffer_bytes);
+          raster_bench_scene(&scene, renderer, &batch);
+          RASTER_BENCH_CHECK(s, res, true);
+          raster.kernels = best;
+          SDL_memset(raster.framebuffer->pixels, 0, framebuffer_bytes);
+          raster_bench_scene(&scene, renderer, &batch);
+        }
+        RASTER_BENCH_CHECK(s, res, false);
+        threads_match = threads_match && match;
+      }
+      if (threads == 1) single_ms = ms;
+      SDL_Log("  %2d threads %8.3f ms per frame, %5.2fx 1 thread, %6.2fx sdl%s", threads, ms,
+              ms > 0 ? single_ms / ms : 0.0, ms > 0 ? sdl_ms / ms : 0.0, threads_match ? "" : " MISMATCH");
+      if (threads == max_threads) break;
+    }
+  }
+#undef RASTER_BENCH_CHECK
+
+  if (!all_match) SDL_Log("raster: output differs from scalar on one thread");
+  raster.kernels = best;
+  soft_raster_set_threads(&raster, max_threads);
+
+  for (int s = 0; s < LEN(scenes); ++s) {
+    SDL_free(expected[s][0]);
+    SDL_free(expected[s][1]);
+  }
+  for (int i = 0; i < num_handles; ++i) asset_loader_release(&loader, handles[i]);
+  asset_loader_shutdown(&loader);
+  soft_raster_destroy(&raster, &resources);
+  sprite_batch_destroy(&batch);
+  resources_shutdown(&resources);
+  SDL_DestroyRenderer(renderer);
+  SDL_DestroySurface(surface);
+  return all_match;
+}
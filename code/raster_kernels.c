@@ -0,0 +1,207 @@
+// Per-pixel kernels of the software rasterizer (soft_raster.c). They run
+// every frame over one span of a row at a time, so each has a scalar version
+// plus SSE2/AVX2 versions picked at runtime. Pixels are ARGB8888 words with
+// premultiplied alpha, for the framebuffer and the textures alike.
+
+#include <SDL_intrin.h>
+
+// dst = src + dst * (255 - src alpha) / 255, rounded like the premultiply
+// at load time, for every channel including alpha.
+static void blend_row_scalar(u32 *dst, const u32 *src, int count) {
+  for (int x = 0; x < count; ++x) {
+    u32 s = src[x];
+    u32 inverse = 255 - (s >> 24);
+    if (inverse == 255) continue;
+    if (inverse == 0) {
+      dst[x] = s;
+      continue;
+    }
+
+    u32 d = dst[x];
+    u32 out = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+      u32 t = ((d >> shift) & 0xff) * inverse + 128;
+      u32 c = ((t + (t >> 8)) >> 8) + ((s >> shift) & 0xff);
+      out |= (c > 255 ? 255 : c) << shift;
+    }
+    dst[x] = out;
+  }
+}
+
+// Alpha is only ever 0 or 255: take the texel or keep the pixel.
+static void select_row_scalar(u32 *dst, const u32 *src, int count) {
+  for (int x = 0; x < count; ++x)
+    if (src[x] >> 24) dst[x] = src[x];
+}
+
+// out[i] = texel at (u + i*du, v + i*dv), nearest, 16.16 fixed point.
+// The caller keeps every sample inside the image.
+static void sample_row_scalar(const u32 *pixels, int stride, s32 u, s32 v, s32 du, s32 dv, u32 *out, int count) {
+  if (dv == 0) {
+    const u32 *row = pixels + (size_t)(v >> 16) * stride;
+    for (int i = 0; i < count; ++i, u += du) out[i] = row[u >> 16];
+    return;
+  }
+  for (int i = 0; i < count; ++i, u += du, v += dv)
+    out[i] = pixels[(size_t)(v >> 16) * stride + (u >> 16)];
+}
+
+#ifdef SDL_SSE2_INTRINSICS
+// Four pixels at a time. Runs of fully transparent or fully opaque texels,
+// most of every sprite, skip the multiplies.
+static void SDL_TARGETING("sse2") blend_row_sse2(u32 *dst, const u32 *src, int count) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i half = _mm_set1_epi16(128);
+  const __m128i alpha_mask = _mm_set1_epi32((int)0xff000000);
+
+  int x = 0;
+  for (; x + 4 <= count; x += 4) {
+    __m128i s = _mm_loadu_si128((const __m128i *)(src + x));
+    __m128i alpha = _mm_and_si128(s, alpha_mask);
+    if (_mm_movemask_epi8(_mm_cmpeq_epi32(alpha, zero)) == 0xffff) continue;
+    if (_mm_movemask_epi8(_mm_cmpeq_epi32(alpha, alpha_mask)) == 0xffff) {
+      _mm_storeu_si128((__m128i *)(dst + x), s);
+      continue;
+    }
+
+    // 255 - alpha in both 16 bit halves of every pixel, then spread over
+    // the four channels of the pixels in each unpacked half.
+    __m128i inverse = _mm_srli_epi32(_mm_xor_si128(s, alpha_mask), 24);
+    inverse = _mm_or_si128(inverse, _mm_slli_epi32(inverse, 16));
+
+    __m128i d = _mm_loadu_si128((const __m128i *)(dst + x));
+    __m128i channels[2] = { _mm_unpacklo_epi8(d, zero), _mm_unpackhi_epi8(d, zero) };
+    __m128i factors[2] = { _mm_unpacklo_epi32(inverse, inverse), _mm_unpackhi_epi32(inverse, inverse) };
+    for (int i = 0; i < 2; ++i) {
+      __m128i t = _mm_add_epi16(_mm_mullo_epi16(channels[i], factors[i]), half);
+      channels[i] = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+    }
+    __m128i out = _mm_adds_epu8(_mm_packus_epi16(channels[0], channels[1]), s);
+    _mm_storeu_si128((__m128i *)(dst + x), out);
+  }
+
+  blend_row_scalar(dst + x, src + x, count - x);
+}
+
+static void SDL_TARGETING("sse2") select_row_sse2(u32 *dst, const u32 *src, int count) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i alpha_mask = _mm_set1_epi32((int)0xff000000);
+
+  int x = 0;
+  for (; x + 4 <= count; x += 4) {
+    __m128i s = _mm_loadu_si128((const __m128i *)(src + x));
+    __m128i keep = _mm_cmpeq_epi32(_mm_and_si128(s, alpha_mask), zero);
+    int mask = _mm_movemask_epi8(keep);
+    if (mask == 0xffff) continue;
+    if (mask == 0) {
+      _mm_storeu_si128((__m128i *)(dst + x), s);
+      continue;
+    }
+    __m128i d = _mm_loadu_si128((const __m128i *)(dst + x));
+    _mm_storeu_si128((__m128i *)(dst + x), _mm_or_si128(_mm_and_si128(keep, d), _mm_andnot_si128(keep, s)));
+  }
+
+  select_row_scalar(dst + x, src + x, count - x);
+}
+#endif
+
+#ifdef SDL_AVX2_INTRINSICS
+// Same as the SSE2 version on 8 pixels, unpack and pack stay inside their
+// 128 bit lanes.
+static void SDL_TARGETING("avx2") blend_row_avx2(u32 *dst, const u32 *src, int count) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i half = _mm256_set1_epi16(128);
+  const __m256i alpha_mask = _mm256_set1_epi32((int)0xff000000);
+
+  int x = 0;
+  for (; x + 8 <= count; x += 8) {
+    __m256i s = _mm256_loadu_si256((const __m256i *)(src + x));
+    __m256i alpha = _mm256_and_si256(s, alpha_mask);
+    if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(alpha, zero)) == -1) continue;
+    if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(alpha, alpha_mask)) == -1) {
+      _mm256_storeu_si256((__m256i *)(dst + x), s);
+      continue;
+    }
+
+    __m256i inverse = _mm256_srli_epi32(_mm256_xor_si256(s, alpha_mask), 24);
+    inverse = _mm256_or_si256(inverse, _mm256_slli_epi32(inverse, 16));
+
+    __m256i d = _mm256_loadu_si256((const __m256i *)(dst + x));
+    __m256i channels[2] = { _mm256_unpacklo_epi8(d, zero), _mm256_unpackhi_epi8(d, zero) };
+    __m256i factors[2] = { _mm256_unpacklo_epi32(inverse, inverse), _mm256_unpackhi_epi32(inverse, inverse) };
+    for (int i = 0; i < 2; ++i) {
+      __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(channels[i], factors[i]), half);
+      channels[i] = _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+    }
+    __m256i out = _mm256_adds_epu8(_mm256_packus_epi16(channels[0], channels[1]), s);
+    _mm256_storeu_si256((__m256i *)(dst + x), out);
+  }
+
+  blend_row_scalar(dst + x, src + x, count - x);
+}
+
+static void SDL_TARGETING("avx2") select_row_avx2(u32 *dst, const u32 *src, int count) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i alpha_mask = _mm256_set1_epi32((int)0xff000000);
+
+  int x = 0;
+  for (; x + 8 <= count; x += 8) {
+    __m256i s = _mm256_loadu_si256((const __m256i *)(src + x));
+    __m256i keep = _mm256_cmpeq_epi32(_mm256_and_si256(s, alpha_mask), zero);
+    __m256i d = _mm256_loadu_si256((const __m256i *)(dst + x));
+    _mm256_storeu_si256((__m256i *)(dst + x), _mm256_blendv_epi8(s, d, keep));
+  }
+
+  select_row_scalar(dst + x, src + x, count - x);
+}
+
+// Eight texels per hardware gather.
+static void SDL_TARGETING("avx2") sample_row_avx2(const u32 *pixels, int stride, s32 u, s32 v, s32 du, s32 dv, u32 *out, int count) {
+  const __m256i steps = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256i row_stride = _mm256_set1_epi32(stride);
+  __m256i us = _mm256_add_epi32(_mm256_set1_epi32(u), _mm256_mullo_epi32(steps, _mm256_set1_epi32(du)));
+  __m256i vs = _mm256_add_epi32(_mm256_set1_epi32(v), _mm256_mullo_epi32(steps, _mm256_set1_epi32(dv)));
+  __m256i u_step = _mm256_set1_epi32(du * 8);
+  __m256i v_step = _mm256_set1_epi32(dv * 8);
+
+  int i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256i index = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_srai_epi32(vs, 16), row_stride), _mm256_srai_epi32(us, 16));
+    _mm256_storeu_si256((__m256i *)(out + i), _mm256_i32gather_epi32((const int *)pixels, index, 4));
+    us = _mm256_add_epi32(us, u_step);
+    vs = _mm256_add_epi32(vs, v_step);
+  }
+
+  sample_row_scalar(pixels, stride, u + i*du, v + i*dv, du, dv, out + i, count - i);
+}
+#endif
+
+typedef void (*BlendRowFn)(u32 *dst, const u32 *src, int count);
+typedef void (*SampleRowFn)(const u32 *pixels, int stride, s32 u, s32 v, s32 du, s32 dv, u32 *out, int count);
+
+typedef struct {
+  const char *name;
+  BlendRowFn blend_row;   // ALPHA_BLENDED textures
+  BlendRowFn select_row;  // ALPHA_BINARY textures
+  SampleRowFn sample_row; // scaled and rotated blits
+} RasterKernels;
+
+// Every variant this CPU can run, slowest first. Returns the count.
+static int raster_kernel_variants(RasterKernels *out) {
+  int count = 0;
+  out[count++] = (RasterKernels){ "scalar", blend_row_scalar, select_row_scalar, sample_row_scalar };
+#ifdef SDL_SSE2_INTRINSICS
+  if (SDL_HasSSE2()) out[count++] = (RasterKernels){ "sse2", blend_row_sse2, select_row_sse2, sample_row_scalar };
+#endif
+#ifdef SDL_AVX2_INTRINSICS
+  if (SDL_HasAVX2()) out[count++] = (RasterKernels){ "avx2", blend_row_avx2, select_row_avx2, sample_row_avx2 };
+#endif
+  return count;
+}
+
+#define RASTER_MAX_KERNEL_VARIANTS 3
+
+static RasterKernels pick_raster_kernels(void) {
+  RasterKernels variants[RASTER_MAX_KERNEL_VARIANTS];
+  return variants[raster_kernel_variants(variants) - 1];
+}
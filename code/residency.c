@@ -0,0 +1,155 @@
+// Texture residency manager for big, rarely shown art (boss screens, light
+// variants of the background). Textures registered here are loaded on first
+// use or on a prefetch hint and evicted least-recently-used first whenever
+// the resident total goes over the byte budget. ResidentHandles stay valid
+// across evictions; residency_use() simply returns NULL until the texture is
+// back in memory, and callers draw their fallback for that frame.
+
+#define RESIDENCY_MAX_TEXTURES 32
+
+typedef s32 ResidentHandle;
+#define INVALID_RESIDENT_HANDLE -1
+
+typedef struct {
+  char name[ASSET_PACK_NAME_SIZE];
+  LoadParams params;
+
+  TexHandle load;          // INVALID_TEX_HANDLE while evicted
+  b8 resident;
+  SpriteSheet sheet;
+
+  u64 bytes;
+  u64 peak_bytes;
+  u64 last_used_frame;
+  u32 num_loads;
+  u32 num_evictions;
+} ResidentTexture;
+
+typedef struct {
+  AssetLoader *loader;
+  u64 budget_bytes;
+  u64 current_bytes;
+  u64 peak_bytes;
+  u64 frame;
+
+  ResidentTexture textures[RESIDENCY_MAX_TEXTURES];
+  int num_textures;
+} Residency;
+
+void residency_init(Residency *residency, AssetLoader *loader, u64 budget_bytes) {
+  SDL_zerop(residency);
+  residency->loader = loader;
+  residency->budget_bytes = budget_bytes;
+}
+
+ResidentHandle residency_register(Residency *residency, const char *name, LoadParams *params) {
+  if (residency->num_textures >= RESIDENCY_MAX_TEXTURES) {
+    SDL_Log("Residency: no slot left for %s", name);
+    return -1;
+  }
+
+  ResidentHandle handle = residency->num_textures++;
+  ResidentTexture *texture = &residency->textures[handle];
+  SDL_zerop(texture);
+  SDL_strlcpy(texture->name, name, sizeof(texture->name));
+  texture->params = *params;
+  texture->load = INVALID_TEX_HANDLE;
+  return handle;
+}
+
+// Starts loading in the background without counting as a use, e.g. when a
+// phase that needs the texture is about to begin.
+void residency_prefetch(Residency *residency, ResidentHandle handle) {
+  if (handle < 0 || handle >= residency->num_textures) return;
+
+  ResidentTexture *texture = &residency->textures[handle];
+  if (texture->load != INVALID_TEX_HANDLE) return;
+
+  texture->load = asset_loader_request_ex(residency->loader, texture->name, &texture->params);
+  texture->num_loads++;
+  // Fresh prefetches should not be the first thing evicted.
+  texture->last_used_frame = residency->frame;
+}
+
+b8 residency_is_resident(Residency *residency, ResidentHandle handle) {
+  return handle >= 0 && handle < residency->num_textures && residency->textures[handle].resident;
+}
+
+// Marks the texture as used this frame. Returns NULL (and starts a load) if
+// it is not resident right now.
+SpriteSheet *residency_use(Residency *residency, ResidentHandle handle) {
+  if (handle < 0 || handle >= residency->num_textures) return NULL;
+
+  ResidentTexture *texture = &residency->textures[handle];
+  texture->last_used_frame = residency->frame;
+  if (texture->resident) return &texture->sheet;
+
+  residency_prefetch(residency, handle);
+  return NULL;
+}
+
+static void residency_evict(Residency *residency, ResidentTexture *texture) {
+  asset_loader_release(residency->loader, texture->load);
+  residency->current_bytes -= texture->bytes;
+
+  texture->load = INVALID_TEX_HANDLE;
+  texture->resident = false;
+  texture->sheet = (SpriteSheet){0};
+  texture->bytes = 0;
+  texture->num_evictions++;
+}
+
+// Call once per frame after asset_loader_pump(): picks up finished loads and
+// evicts until the budget holds again. Textures used this frame are never
+// evicted, so a single oversized texture can still push us over budget.
+void residency_update(Residency *residency) {
+  for (int i = 0; i < residency->num_textures; ++i) {
+    ResidentTexture *texture = &residency->textures[i];
+    if (texture->resident || texture->load == INVALID_TEX_HANDLE) continue;
+
+    SpriteSheet sheet = asset_loader_get_sheet(residency->loader, texture->load);
+    if (sheet_is_loaded(&sheet)) {
+      texture->sheet = sheet;
+      texture->resident = true;
+      texture->bytes = asset_loader_bytes(residency->loader, texture->load);
+      texture->peak_bytes = MAX(texture->peak_bytes, texture->bytes);
+      residency->current_bytes += texture->bytes;
+      residency->peak_bytes = MAX(residency->peak_bytes, residency->current_bytes);
+    }
+    // A failed load keeps its loader handle, so it is not retried every frame.
+  }
+
+  while (residency->current_bytes > residency->budget_bytes) {
+    ResidentTexture *oldest = NULL;
+    for (int i = 0; i < residency->num_textures; ++i) {
+      ResidentTexture *texture = &residency->textures[i];
+      if (!texture->resident || texture->last_used_frame >= residency->frame) continue;
+      if (!oldest || texture->last_used_frame < oldest->last_used_frame) oldest = texture;
+    }
+    if (!oldest) break;
+
+    SDL_Log("Residency: evicting %s (%.2f MB)", oldest->name, oldest->bytes / (1024.0 * 1024.0));
+    residency_evict(residency, oldest);
+  }
+
+  residency->frame++;
+}
+
+void residency_report(Residency *residency) {
+  SDL_Log("Residency: %.2f MB resident, %.2f MB peak, %.2f MB budget",
+          residency->current_bytes / (1024.0 * 1024.0), residency->peak_bytes / (1024.0 * 1024.0),
+          residency->budget_bytes / (1024.0 * 1024.0));
+  for (int i = 0; i < residency->num_textures; ++i) {
+    ResidentTexture *texture = &residency->textures[i];
+    SDL_Log("  %-32s %8.2f MB now %8.2f MB peak, %u loads, %u evictions", texture->name,
+            texture->bytes / (1024.0 * 1024.0), texture->peak_bytes / (1024.0 * 1024.0),
+            texture->num_loads, texture->num_evictions);
+  }
+}
+
+void residency_shutdown(Residency *residency) {
+  for (int i = 0; i < residency->num_textures; ++i) {
+    ResidentTexture *texture = &residency->textures[i];
+    if (texture->resident) residency_evict(residency, texture);
+  }
+}
@@ -0,0 +1,154 @@
+// Central registry for everything that holds on to texture or audio memory.
+// Every texture and wave buffer is tracked here with its size and category
+// and gets released through the registry again. Whatever is still alive at
+// resources_shutdown() is reported as a leak and destroyed, together with
+// the current and peak usage per category.
+
+#define RESOURCES_MAX      256
+#define RESOURCE_NAME_SIZE 48
+
+enum ResourceCategory {
+  RESOURCE_TEXTURE,      // sprite sheets, backgrounds, overlays
+  RESOURCE_MIP,          // downscaled copies of a texture
+  RESOURCE_ATLAS_PAGE,
+  RESOURCE_AUDIO,
+  RESOURCE_CATEGORY_COUNT
+};
+
+static const char *resource_category_names[RESOURCE_CATEGORY_COUNT] = {
+  "texture",
+  "mip",
+  "atlas page",
+  "audio",
+};
+
+typedef struct {
+  char name[RESOURCE_NAME_SIZE];
+  enum ResourceCategory category;
+  void *ptr;   // SDL_Texture*, or the wave buffer for audio
+  u64 bytes;
+  b8 alive;
+} Resource;
+
+typedef struct {
+  Resource entries[RESOURCES_MAX];
+  int num_entries;
+
+  u64 bytes[RESOURCE_CATEGORY_COUNT];
+  u64 peak_bytes[RESOURCE_CATEGORY_COUNT];
+  u64 total_bytes;
+  u64 peak_total_bytes;
+} ResourceRegistry;
+
+static f64 resource_mb(u64 bytes) {
+  return bytes / (1024.0 * 1024.0);
+}
+
+static void resources_add(ResourceRegistry *registry, const char *name, enum ResourceCategory category, void *ptr, u64 bytes) {
+  if (!ptr) return;
+
+  Resource *entry = NULL;
+  for (int i = 0; i < registry->num_entries; ++i) {
+    if (!registry->entries[i].alive) {
+      entry = &registry->entries[i];
+      break;
+    }
+  }
+  if (!entry) {
+    if (registry->num_entries >= RESOURCES_MAX) {
+      SDL_Log("Resource registry full, %s is not tracked", name);
+      return;
+    }
+    entry = &registry->entries[registry->num_entries++];
+  }
+
+  SDL_strlcpy(entry->name, name, sizeof(entry->name));
+  entry->category = category;
+  entry->ptr = ptr;
+  entry->bytes = bytes;
+  entry->alive = true;
+
+  registry->bytes[category] += bytes;
+  registry->total_bytes += bytes;
+  registry->peak_bytes[category] = MAX(registry->peak_bytes[category], registry->bytes[category]);
+  registry->peak_total_bytes = MAX(registry->peak_total_bytes, registry->total_bytes);
+}
+
+static Resource *resources_find(ResourceRegistry *registry, void *ptr) {
+  for (int i = 0; i < registry->num_entries; ++i)
+    if (registry->entries[i].alive && registry->entries[i].ptr == ptr) return &registry->entries[i];
+  return NULL;
+}
+
+static void resources_destroy(Resource *entry) {
+  if (entry->category == RESOURCE_AUDIO) SDL_free(entry->ptr);
+  else SDL_DestroyTexture(entry->ptr);
+}
+
+static void resources_remove(ResourceRegistry *registry, Resource *entry) {
+  registry->bytes[entry->category] -= entry->bytes;
+  registry->total_bytes -= entry->bytes;
+  entry->alive = false;
+  entry->ptr = NULL;
+}
+
+SDL_Texture *resources_track_texture(ResourceRegistry *registry, SDL_Texture *texture, const char *name, enum ResourceCategory category) {
+  if (texture) {
+    u64 bytes = (u64)texture->w * texture->h * SDL_BYTESPERPIXEL(texture->format);
+    resources_add(registry, name, category, texture, bytes);
+  }
+  return texture;
+}
+
+void resources_track_audio(ResourceRegistry *registry, u8 *wave_buf, u32 wave_len, const char *name) {
+  resources_add(registry, name, RESOURCE_AUDIO, wave_buf, wave_len);
+}
+
+// Destroys ptr (texture or wave buffer) and stops tracking it. Untracked
+// pointers are destroyed anyway but logged, they escaped the registry.
+void resources_release(ResourceRegistry *registry, void *ptr, enum ResourceCategory category) {
+  if (!ptr) return;
+
+  Resource *entry = resources_find(registry, ptr);
+  if (!entry) {
+    SDL_Log("Resource %p was never registered", ptr);
+    Resource untracked = { .category = category, .ptr = ptr };
+    resources_destroy(&untracked);
+    return;
+  }
+
+  resources_destroy(entry);
+  resources_remove(registry, entry);
+}
+
+void resources_report(ResourceRegistry *registry) {
+  SDL_Log("Resources: %.2f MB live, %.2f MB peak", resource_mb(registry->total_bytes), resource_mb(registry->peak_total_bytes));
+  for (int c = 0; c < RESOURCE_CATEGORY_COUNT; ++c) {
+    SDL_Log("  %-12s %8.2f MB live %8.2f MB peak", resource_category_names[c],
+            resource_mb(registry->bytes[c]), resource_mb(registry->peak_bytes[c]));
+  }
+}
+
+// Reports and destroys everything the owners did not release themselves.
+void resources_shutdown(ResourceRegistry *registry) {
+  int num_leaks = 0;
+  u64 leaked_bytes = 0;
+  for (int i = 0; i < registry->num_entries; ++i) {
+    Resource *entry = &registry->entries[i];
+    if (!entry->alive) continue;
+
+    SDL_Log("Leak: %-32s %-12s %8.2f MB", entry->name, resource_category_names[entry->category], resource_mb(entry->bytes));
+    num_leaks++;
+    leaked_bytes += entry->bytes;
+
+    resources_destroy(entry);
+    resources_remove(registry, entry);
+  }
+
+  if (num_leaks) SDL_Log("Resources: %d leaks, %.2f MB", num_leaks, resource_mb(leaked_bytes));
+  else SDL_Log("Resources: no leaks");
+
+  SDL_Log("Resources: peak %.2f MB", resource_mb(registry->peak_total_bytes));
+  for (int c = 0; c < RESOURCE_CATEGORY_COUNT; ++c)
+    SDL_Log("  %-12s %8.2f MB peak", resource_category_names[c], resource_mb(registry->peak_bytes[c]));
+}
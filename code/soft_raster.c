@@ -0,0 +1,544 @@
+// Software sprite rasterizer for machines without a GPU, selected with
+// --raster soft. SDL's software renderer has no specialized scaled alpha
+// blend, so instead every sprite is drawn here into a CPU framebuffer with
+// the kernels in raster_kernels.c, and the framebuffer is streamed into one
+// SDL_TEXTUREACCESS_STREAMING texture per frame. The SDL renderer then only
+// copies that texture to the window.
+//
+// Textures keep a CPU copy of their pixels (ARGB8888, premultiplied) as a
+// texture property, attached by soft_texture_attach() wherever pixels are
+// uploaded. It is freed together with the texture. Every quad is an affine
+// mapping from screen to texels: spans are sampled nearest into a row buffer
+// (or read straight from the texture when the blit is unscaled) and then
+// copied, selected or blended depending on the texture's alpha class.
+//
+// Quads are not drawn right away. They are queued, and soft_raster_flush()
+// bins them into SOFT_TILE_W x SOFT_TILE_H screen tiles and rasterizes the
+// tiles in parallel on a worker pool, every tile in queue order. Samples
+// only depend on the pixel, not on the tile, so the result is the same for
+// any thread count.
+//
+// Compare with SDL's own software renderer with --bench-raster
+// (raster_bench.c).
+
+#define SOFT_RASTER_PROPERTY "game.soft_raster"  // SoftRaster* on the renderer
+#define SOFT_IMAGE_PROPERTY  "game.soft_image"   // SoftImage* on a texture
+
+#define SOFT_RASTER_MAX_QUADS   2048
+#define SOFT_RASTER_MAX_THREADS 32
+#define SOFT_TILE_W 128
+#define SOFT_TILE_H 64
+
+typedef struct {
+  u32 *pixels;  // ARGB8888, premultiplied
+  int width;
+  int height;
+  int stride;   // in pixels
+  enum AlphaClass alpha;
+} SoftImage;
+
+// One queued quad, set up for rasterizing. See soft_raster_quad().
+typedef struct {
+  SoftImage *image; // NULL fills bounds with color
+  u32 color;
+  SDL_Rect bounds;  // pixels it may touch, clip included
+
+  f64 x0, y0;       // screen position of (s, t) = (0, 0)
+  f64 dsdx, dsdy, dtdx, dtdy;
+  f64 u0, v0, u_size, v_size;
+  s32 du, dv;       // 16.16 texels per pixel along x
+  s32 u_min, u_max, v_min, v_max;
+  b8 unscaled;
+} SoftQuad;
+
+typedef struct SoftRaster SoftRaster;
+
+typedef struct {
+  SoftRaster *raster;
+  SDL_Thread *thread;
+  u32 span[SOFT_TILE_W]; // sampled texels of one row inside a tile
+  u64 num_pixels;
+} SoftWorker;
+
+struct SoftRaster {
+  SDL_Renderer *renderer;
+  SDL_Texture *screen;     // streaming, gets the framebuffer every frame
+  SoftImage *framebuffer;  // attached to screen
+  SoftImage *target;       // framebuffer, or a layer cache
+  SDL_Rect clip;           // inside target
+  SDL_Rect view;           // part of the framebuffer that is presented, see soft_raster_set_scale()
+  f32 scale_x, scale_y;    // applied to quads drawn into the framebuffer
+  RasterKernels kernels;
+
+  SoftQuad quads[SOFT_RASTER_MAX_QUADS];
+  int num_queued;
+
+  // The quads of tile i are tile_refs[tile_offsets[i] .. tile_offsets[i + 1]].
+  int tiles_x;
+  int tiles_y;
+  int *tile_offsets;
+  u32 *tile_refs;
+  int tile_refs_capacity;
+
+  // workers[0] is whoever calls soft_raster_flush(), the others wait on start.
+  SoftWorker workers[SOFT_RASTER_MAX_THREADS];
+  int num_workers;         // running, the caller included
+  int num_threads;         // of those, how many take tiles
+  SDL_Semaphore *start;
+  SDL_Semaphore *done;
+  SDL_AtomicInt next_tile;
+  SDL_AtomicInt quit;
+
+  // Quads and pixels drawn, time spent. The frame_* values are the last
+  // presented frame.
+  int num_quads;
+  u64 num_pixels;
+  u64 ticks;
+  int frame_quads;
+  u64 frame_pixels;
+  f64 frame_ms;
+};
+
+static void SDLCALL soft_image_free(void *userdata, void *value) {
+  (void)userdata;
+  SDL_free(value);
+}
+
+// Keeps a CPU copy of pixels (any format SDL_ConvertPixels knows, NULL for
+// a cleared image) next to texture, if its renderer belongs to a
+// SoftRaster. Returns NULL otherwise.
+SoftImage *soft_texture_attach(SDL_Texture *texture, const void *pixels, int pitch, SDL_PixelFormat format, enum AlphaClass alpha) {
+  SDL_Renderer *renderer = SDL_GetRendererFromTexture(texture);
+  if (!renderer || !SDL_GetPointerProperty(SDL_GetRendererProperties(renderer), SOFT_RASTER_PROPERTY, NULL)) return NULL;
+
+  int width = texture->w, height = texture->h;
+  SoftImage *image = SDL_malloc(sizeof(SoftImage) + (size_t)width * height * 4);
+  if (!image) return NULL;
+
+  *image = (SoftImage){ (u32 *)(image + 1), width, height, width, alpha };
+  if (!pixels) SDL_memset(image->pixels, 0, (size_t)width * height * 4);
+  else if (!SDL_ConvertPixels(width, height, format, pixels, pitch, SDL_PIXELFORMAT_ARGB8888, image->pixels, width * 4)) {
+    SDL_Log("Soft raster could not convert %s: %s", SDL_GetPixelFormatName(format), SDL_GetError());
+    SDL_free(image);
+    return NULL;
+  }
+
+  if (!SDL_SetPointerPropertyWithCleanup(SDL_GetTextureProperties(texture), SOFT_IMAGE_PROPERTY, image, soft_image_free, NULL))
+    return NULL;
+  return image;
+}
+
+SoftImage *soft_texture_image(SDL_Texture *texture) {
+  return texture ? SDL_GetPointerProperty(SDL_GetTextureProperties(texture), SOFT_IMAGE_PROPERTY, NULL) : NULL;
+}
+
+// Rasterizes the part of quad inside tile.
+static void soft_quad_draw(SoftRaster *raster, SoftWorker *worker, SoftQuad *quad, SDL_Rect *tile) {
+  SoftImage *target = raster->target;
+  SDL_Rect area;
+  if (!SDL_GetRectIntersection(&quad->bounds, tile, &area)) return;
+
+  if (!quad->image) {
+    for (int y = area.y; y < area.y + area.h; ++y) {
+      u32 *row = target->pixels + (size_t)y * target->stride + area.x;
+      if ((quad->color >> 24) == 255) {
+        SDL_memset4(row, quad->color, (size_t)area.w);
+      } else {
+        for (int x = 0; x < area.w; ++x) worker->span[x] = quad->color;
+        raster->kernels.blend_row(row, worker->span, area.w);
+      }
+    }
+    worker->num_pixels += (u64)area.w * area.h;
+    return;
+  }
+
+  SoftImage *image = quad->image;
+  for (int y = area.y; y < area.y + area.h; ++y) {
+    // s and t at the center of pixel x are s_row + x*dsdx, t_row + x*dtdx.
+    f64 py = y + 0.5 - quad->y0;
+    f64 s_row = (0.5 - quad->x0) * quad->dsdx + py * quad->dsdy;
+    f64 t_row = (0.5 - quad->x0) * quad->dtdx + py * quad->dtdy;
+
+    // Pixels whose center lands inside [0, 1) in both s and t.
+    f64 lo = area.x, hi = area.x + area.w;
+    f64 params[2][2] = { { s_row, quad->dsdx }, { t_row, quad->dtdx } };
+    for (int i = 0; i < 2; ++i) {
+      f64 value = params[i][0], slope = params[i][1];
+      if (slope == 0.0) {
+        if (value < 0.0 || value >= 1.0) hi = lo;
+        continue;
+      }
+      f64 a = -value / slope, b = (1.0 - value) / slope;
+      lo = SDL_max(lo, SDL_min(a, b));
+      hi = SDL_min(hi, SDL_max(a, b));
+    }
+    int x_start = (int)SDL_ceil(lo), x_end = (int)SDL_ceil(hi);
+    if (x_start >= x_end) continue;
+
+    // Stepped from x = 0 of the row, so every tile gets the same samples.
+    s64 u_origin = (s64)((quad->u0 + s_row * quad->u_size) * 65536.0);
+    s64 v_origin = (s64)((quad->v0 + t_row * quad->v_size) * 65536.0);
+    s32 u = (s32)(u_origin + (s64)x_start * quad->du);
+    s32 v = (s32)(v_origin + (s64)x_start * quad->dv);
+
+    // Float error can put the outermost samples just past the edge.
+    while (x_start < x_end && (u < quad->u_min || u > quad->u_max || v < quad->v_min || v > quad->v_max)) {
+      x_start++;
+      u += quad->du;
+      v += quad->dv;
+    }
+    while (x_end > x_start) {
+      s32 u_last = u + quad->du * (x_end - 1 - x_start), v_last = v + quad->dv * (x_end - 1 - x_start);
+      if (u_last >= quad->u_min && u_last <= quad->u_max && v_last >= quad->v_min && v_last <= quad->v_max) break;
+      x_end--;
+    }
+    int count = x_end - x_start;
+    if (count <= 0) continue;
+
+    const u32 *src;
+    if (quad->unscaled) {
+      src = image->pixels + (size_t)(v >> 16) * image->stride + (u >> 16);
+    } else {
+      raster->kernels.sample_row(image->pixels, image->stride, u, v, quad->du, quad->dv, worker->span, count);
+      src = worker->span;
+    }
+
+    u32 *dst = target->pixels + (size_t)y * target->stride + x_start;
+    switch (image->alpha) {
+      case ALPHA_OPAQUE:  SDL_memcpy(dst, src, (size_t)count * 4); break;
+      case ALPHA_BINARY:  raster->kernels.select_row(dst, src, count); break;
+      case ALPHA_BLENDED: raster->kernels.blend_row(dst, src, count); break;
+    }
+    worker->num_pixels += (u64)count;
+  }
+}
+
+static void soft_raster_run_tiles(SoftRaster *raster, SoftWorker *worker) {
+  int num_tiles = raster->tiles_x * raster->tiles_y;
+  PROFILE_BEGIN("raster tiles");
+  for (;;) {
+    int tile = SDL_AddAtomicInt(&raster->next_tile, 1);
+    if (tile >= num_tiles) break;
+
+    SDL_Rect rect = { (tile % raster->tiles_x) * SOFT_TILE_W, (tile / raster->tiles_x) * SOFT_TILE_H, SOFT_TILE_W, SOFT_TILE_H };
+    for (int i = raster->tile_offsets[tile]; i < raster->tile_offsets[tile + 1]; ++i)
+      soft_quad_draw(raster, worker, &raster->quads[raster->tile_refs[i]], &rect);
+  }
+  PROFILE_END();
+}
+
+static int SDLCALL soft_raster_worker(void *userdata) {
+  SoftWorker *worker = userdata;
+  SoftRaster *raster = worker->raster;
+  PROFILE_THREAD_NAME("soft raster");
+  for (;;) {
+    SDL_WaitSemaphore(raster->start);
+    if (SDL_GetAtomicInt(&raster->quit)) break;
+    soft_raster_run_tiles(raster, worker);
+    SDL_SignalSemaphore(raster->done);
+  }
+  return 0;
+}
+
+// The range of tiles quad's bounds touch, in tiles.
+static SDL_Rect soft_quad_tiles(SoftQuad *quad) {
+  int x0 = quad->bounds.x / SOFT_TILE_W, x1 = (quad->bounds.x + quad->bounds.w - 1) / SOFT_TILE_W;
+  int y0 = quad->bounds.y / SOFT_TILE_H, y1 = (quad->bounds.y + quad->bounds.h - 1) / SOFT_TILE_H;
+  return (SDL_Rect){ x0, y0, x1 - x0 + 1, y1 - y0 + 1 };
+}
+
+// Counts, then places every quad's index into the tiles its bounds touch.
+static b8 soft_raster_bin(SoftRaster *raster) {
+  int tiles_x = (raster->target->width + SOFT_TILE_W - 1) / SOFT_TILE_W;
+  int tiles_y = (raster->target->height + SOFT_TILE_H - 1) / SOFT_TILE_H;
+  if (tiles_x * tiles_y > raster->tiles_x * raster->tiles_y) {
+    int *offsets = SDL_realloc(raster->tile_offsets, sizeof(int) * (tiles_x * tiles_y + 1));
+    if (!offsets) return false;
+    raster->tile_offsets = offsets;
+  }
+  raster->tiles_x = tiles_x;
+  raster->tiles_y = tiles_y;
+  int *offsets = raster->tile_offsets;
+  SDL_memset(offsets, 0, sizeof(int) * (tiles_x * tiles_y + 1));
+
+  int total = 0;
+  for (int i = 0; i < raster->num_queued; ++i) {
+    SDL_Rect tiles = soft_quad_tiles(&raster->quads[i]);
+    for (int ty = tiles.y; ty < tiles.y + tiles.h; ++ty)
+      for (int tx = tiles.x; tx < tiles.x + tiles.w; ++tx) offsets[ty * tiles_x + tx + 1]++;
+    total += tiles.w * tiles.h;
+  }
+  if (total > raster->tile_refs_capacity) {
+    u32 *refs = SDL_realloc(raster->tile_refs, sizeof(u32) * total);
+    if (!refs) return false;
+    raster->tile_refs = refs;
+    raster->tile_refs_capacity = total;
+  }
+
+  for (int tile = 0; tile < tiles_x * tiles_y; ++tile) offsets[tile + 1] += offsets[tile];
+  for (int i = 0; i < raster->num_queued; ++i) {
+    SDL_Rect tiles = soft_quad_tiles(&raster->quads[i]);
+    for (int ty = tiles.y; ty < tiles.y + tiles.h; ++ty)
+      for (int tx = tiles.x; tx < tiles.x + tiles.w; ++tx) raster->tile_refs[offsets[ty * tiles_x + tx]++] = (u32)i;
+  }
+
+  // Placing moved every offset up to the start of the next tile.
+  for (int tile = tiles_x * tiles_y; tile > 0; --tile) offsets[tile] = offsets[tile - 1];
+  offsets[0] = 0;
+  return true;
+}
+
+// Draws everything queued so far into the target.
+void soft_raster_flush(SoftRaster *raster) {
+  if (raster->num_queued == 0) return;
+  u64 start = SDL_GetPerformanceCounter();
+  PROFILE_BEGIN("raster flush");
+
+  if (soft_raster_bin(raster)) {
+    SDL_SetAtomicInt(&raster->next_tile, 0);
+    for (int i = 1; i < raster->num_threads; ++i) SDL_SignalSemaphore(raster->start);
+    soft_raster_run_tiles(raster, &raster->workers[0]);
+    for (int i = 1; i < raster->num_threads; ++i) SDL_WaitSemaphore(raster->done);
+
+    for (int i = 0; i < raster->num_workers; ++i) {
+      raster->num_pixels += raster->workers[i].num_pixels;
+      raster->workers[i].num_pixels = 0;
+    }
+  } else {
+    SDL_Log("Soft raster out of memory for binning, %d quads dropped", raster->num_queued);
+  }
+
+  raster->num_queued = 0;
+  raster->ticks += SDL_GetPerformanceCounter() - start;
+  PROFILE_END();
+}
+
+static SoftQuad *soft_raster_queue(SoftRaster *raster, SDL_Rect *bounds) {
+  SDL_Rect clipped;
+  if (!SDL_GetRectIntersection(bounds, &raster->clip, &clipped)) return NULL;
+  if (raster->num_queued == SOFT_RASTER_MAX_QUADS) soft_raster_flush(raster);
+
+  SoftQuad *quad = &raster->quads[raster->num_queued++];
+  *quad = (SoftQuad){ .bounds = clipped };
+  raster->num_quads++;
+  return quad;
+}
+
+// NULL targets the framebuffer. Resets the clip rect.
+void soft_raster_set_target(SoftRaster *raster, SoftImage *target) {
+  soft_raster_flush(raster);
+  raster->target = target ? target : raster->framebuffer;
+  raster->clip = raster->target == raster->framebuffer ? raster->view : (SDL_Rect){ 0, 0, raster->target->width, raster->target->height };
+}
+
+// Draws the framebuffer's quads scaled down into its top left width x height
+// pixels, soft_raster_present() stretches those over the whole screen. Layer
+// caches are not affected.
+void soft_raster_set_scale(SoftRaster *raster, int width, int height) {
+  soft_raster_flush(raster);
+  SoftImage *framebuffer = raster->framebuffer;
+  raster->view = (SDL_Rect){ 0, 0, SDL_clamp(width, 1, framebuffer->width), SDL_clamp(height, 1, framebuffer->height) };
+  raster->scale_x = (f32)raster->view.w / framebuffer->width;
+  raster->scale_y = (f32)raster->view.h / framebuffer->height;
+  if (raster->target == framebuffer) raster->clip = raster->view;
+}
+
+// NULL clips to the whole target. Applies to quads queued afterwards.
+void soft_raster_set_clip(SoftRaster *raster, const SDL_Rect *clip) {
+  SDL_Rect all = raster->target == raster->framebuffer ? raster->view : (SDL_Rect){ 0, 0, raster->target->width, raster->target->height };
+  if (!clip || !SDL_GetRectIntersection(clip, &all, &raster->clip)) raster->clip = clip ? (SDL_Rect){0} : all;
+}
+
+// Up to the number of workers started by soft_raster_init().
+void soft_raster_set_threads(SoftRaster *raster, int num_threads) {
+  raster->num_threads = SDL_clamp(num_threads, 1, raster->num_workers);
+}
+
+// Must come before anything is loaded, textures only keep CPU pixels once
+// their renderer has a SoftRaster. num_threads 0 uses every core.
+b8 soft_raster_init(SoftRaster *raster, SDL_Renderer *renderer, ResourceRegistry *resources, int width, int height, int num_threads) {
+  SDL_zerop(raster);
+  raster->renderer = renderer;
+  raster->kernels = pick_raster_kernels();
+
+  raster->screen = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_XRGB8888, SDL_TEXTUREACCESS_STREAMING, width, height);
+  if (!raster->screen) {
+    SDL_Log("Soft raster framebuffer could not be created: %s", SDL_GetError());
+    return false;
+  }
+  SDL_SetTextureBlendMode(raster->screen, SDL_BLENDMODE_NONE);
+  resources_track_texture(resources, raster->screen, "soft raster framebuffer", RESOURCE_TEXTURE);
+
+  SDL_SetPointerProperty(SDL_GetRendererProperties(renderer), SOFT_RASTER_PROPERTY, raster);
+  raster->framebuffer = soft_texture_attach(raster->screen, NULL, 0, SDL_PIXELFORMAT_ARGB8888, ALPHA_OPAQUE);
+  raster->start = SDL_CreateSemaphore(0);
+  raster->done = SDL_CreateSemaphore(0);
+  if (!raster->framebuffer || !raster->start || !raster->done) {
+    SDL_Log("Soft raster could not be created: %s", SDL_GetError());
+    SDL_DestroySemaphore(raster->start);
+    SDL_DestroySemaphore(raster->done);
+    SDL_ClearProperty(SDL_GetRendererProperties(renderer), SOFT_RASTER_PROPERTY);
+    resources_release(resources, raster->screen, RESOURCE_TEXTURE);
+    return false;
+  }
+  raster->target = raster->framebuffer;
+  raster->view = raster->clip = (SDL_Rect){ 0, 0, width, height };
+  raster->scale_x = raster->scale_y = 1.f;
+
+  if (num_threads <= 0) num_threads = SDL_GetNumLogicalCPUCores();
+  num_threads = SDL_clamp(num_threads, 1, SOFT_RASTER_MAX_THREADS);
+  raster->workers[0].raster = raster;
+  raster->num_workers = 1;
+  for (int i = 1; i < num_threads; ++i) {
+    SoftWorker *worker = &raster->workers[i];
+    worker->raster = raster;
+    worker->thread = SDL_CreateThread(soft_raster_worker, "soft raster", worker);
+    if (!worker->thread) {
+      SDL_Log("Soft raster thread could not be created: %s", SDL_GetError());
+      break;
+    }
+    raster->num_workers++;
+  }
+  raster->num_threads = raster->num_workers;
+
+  SDL_Log("soft raster: %dx%d, %s kernels, %d threads, %dx%d tiles",
+          width, height, raster->kernels.name, raster->num_threads, SOFT_TILE_W, SOFT_TILE_H);
+  return true;
+}
+
+static u32 soft_raster_color(SDL_FColor color) {
+  u32 a = (u32)(SDL_clamp(color.a, 0.f, 1.f) * 255.f + 0.5f);
+  u32 r = (u32)(SDL_clamp(color.r * color.a, 0.f, 1.f) * 255.f + 0.5f);
+  u32 g = (u32)(SDL_clamp(color.g * color.a, 0.f, 1.f) * 255.f + 0.5f);
+  u32 b = (u32)(SDL_clamp(color.b * color.a, 0.f, 1.f) * 255.f + 0.5f);
+  return a << 24 | r << 16 | g << 8 | b;
+}
+
+// argb is premultiplied, opaque fills are plain stores.
+void soft_raster_fill(SoftRaster *raster, const SDL_Rect *rect, u32 argb) {
+  SoftQuad *quad = soft_raster_queue(raster, (SDL_Rect *)rect);
+  if (quad) quad->color = argb;
+}
+
+// Queues the quad v[0..3] (clockwise from top left, texture coordinates
+// axis-aligned, like sprite_batch_quad() makes them). Without a texture the
+// quad's bounding box is filled with the color of v[0]. Textures without a
+// CPU copy are skipped.
+void soft_raster_quad(SoftRaster *raster, SDL_Texture *texture, const SDL_Vertex *v) {
+  SDL_Vertex scaled[4];
+  if (raster->target == raster->framebuffer && (raster->scale_x != 1.f || raster->scale_y != 1.f)) {
+    for (int i = 0; i < 4; ++i) {
+      scaled[i] = v[i];
+      scaled[i].position.x *= raster->scale_x;
+      scaled[i].position.y *= raster->scale_y;
+    }
+    v = scaled;
+  }
+
+  f32 min_x = v[0].position.x, max_x = min_x, min_y = v[0].position.y, max_y = min_y;
+  for (int i = 1; i < 4; ++i) {
+    min_x = SDL_min(min_x, v[i].position.x);
+    max_x = SDL_max(max_x, v[i].position.x);
+    min_y = SDL_min(min_y, v[i].position.y);
+    max_y = SDL_max(max_y, v[i].position.y);
+  }
+  // Pixels whose center is inside the bounding box.
+  int x0 = (int)SDL_ceilf(min_x - 0.5f), y0 = (int)SDL_ceilf(min_y - 0.5f);
+  SDL_Rect bounds = { x0, y0, (int)SDL_ceilf(max_x - 0.5f) - x0, (int)SDL_ceilf(max_y - 0.5f) - y0 };
+
+  if (!texture) {
+    soft_raster_fill(raster, &bounds, soft_raster_color(v[0].color));
+    return;
+  }
+
+  SoftImage *image = soft_texture_image(texture);
+  if (!image) return;
+
+  // Screen to (s, t) in the unit square of the quad, then to texels.
+  f64 ex_x = v[1].position.x - v[0].position.x, ex_y = v[1].position.y - v[0].position.y;
+  f64 ey_x = v[3].position.x - v[0].position.x, ey_y = v[3].position.y - v[0].position.y;
+  f64 det = ex_x * ey_y - ex_y * ey_x;
+  if (SDL_fabs(det) < 1e-6) return;
+
+  SoftQuad *quad = soft_raster_queue(raster, &bounds);
+  if (!quad) return;
+
+  quad->image = image;
+  quad->x0 = v[0].position.x;
+  quad->y0 = v[0].position.y;
+  quad->u0 = (f64)v[0].tex_coord.x * image->width;
+  quad->v0 = (f64)v[0].tex_coord.y * image->height;
+  quad->u_size = ((f64)v[1].tex_coord.x - v[0].tex_coord.x) * image->width;
+  quad->v_size = ((f64)v[3].tex_coord.y - v[0].tex_coord.y) * image->height;
+  quad->dsdx =  ey_y / det;
+  quad->dsdy = -ey_x / det;
+  quad->dtdx = -ex_y / det;
+  quad->dtdy =  ex_x / det;
+  quad->du = (s32)(quad->dsdx * quad->u_size * 65536.0);
+  quad->dv = (s32)(quad->dtdx * quad->v_size * 65536.0);
+  quad->unscaled = quad->du == 65536 && quad->dv == 0 && quad->dsdy == 0.0;
+
+  // Samples stay inside the source rect, rounding never reaches a neighbour.
+  f64 u_end = quad->u0 + quad->u_size, v_end = quad->v0 + quad->v_size;
+  quad->u_min = SDL_max((s32)SDL_floor(SDL_min(quad->u0, u_end)), 0) << 16;
+  quad->v_min = SDL_max((s32)SDL_floor(SDL_min(quad->v0, v_end)), 0) << 16;
+  quad->u_max = (SDL_min((s32)SDL_ceil(SDL_max(quad->u0, u_end)), image->width) << 16) - 1;
+  quad->v_max = (SDL_min((s32)SDL_ceil(SDL_max(quad->v0, v_end)), image->height) << 16) - 1;
+}
+
+// Axis-aligned blit, src in texels and dst in target pixels.
+void soft_raster_blit(SoftRaster *raster, SDL_Texture *texture, SDL_FRect *src, SDL_FRect *dst) {
+  f32 u0 = src->x / texture->w, u1 = (src->x + src->w) / texture->w;
+  f32 v0 = src->y / texture->h, v1 = (src->y + src->h) / texture->h;
+  SDL_FColor white = { 1, 1, 1, 1 };
+  SDL_Vertex vertices[4] = {
+    { { dst->x,          dst->y          }, white, { u0, v0 } },
+    { { dst->x + dst->w, dst->y          }, white, { u1, v0 } },
+    { { dst->x + dst->w, dst->y + dst->h }, white, { u1, v1 } },
+    { { dst->x,          dst->y + dst->h }, white, { u0, v1 } },
+  };
+  soft_raster_quad(raster, texture, vertices);
+}
+
+// Streams the framebuffer to the screen texture, only rects if given, and
+// draws it over the whole render target. Closes the frame's stats.
+void soft_raster_present(SoftRaster *raster, const SDL_Rect *rects, int num_rects) {
+  soft_raster_flush(raster);
+
+  SoftImage *framebuffer = raster->framebuffer;
+  int pitch = framebuffer->stride * 4;
+  SDL_Rect view = raster->view;
+  if (!rects) {
+    SDL_UpdateTexture(raster->screen, &view, framebuffer->pixels, pitch);
+  } else {
+    for (int i = 0; i < num_rects; ++i)
+      SDL_UpdateTexture(raster->screen, &rects[i], framebuffer->pixels + (size_t)rects[i].y * framebuffer->stride + rects[i].x, pitch);
+  }
+  SDL_RenderTexture(raster->renderer, raster->screen, &(SDL_FRect){ 0, 0, (f32)view.w, (f32)view.h }, NULL);
+
+  raster->frame_quads = raster->num_quads;
+  raster->frame_pixels = raster->num_pixels;
+  raster->frame_ms = raster->ticks * 1000.0 / SDL_GetPerformanceFrequency();
+  raster->num_quads = 0;
+  raster->num_pixels = 0;
+  raster->ticks = 0;
+}
+
+void soft_raster_report(SoftRaster *raster) {
+  SDL_Log("soft raster (%s, %d threads): %d quads, %.2f Mpixels in %.3f ms",
+          raster->kernels.name, raster->num_threads, raster->frame_quads, raster->frame_pixels / 1e6, raster->frame_ms);
+}
+
+void soft_raster_destroy(SoftRaster *raster, ResourceRegistry *resources) {
+  SDL_SetAtomicInt(&raster->quit, 1);
+  for (int i = 1; i < raster->num_workers; ++i) SDL_SignalSemaphore(raster->start);
+  for (int i = 1; i < raster->num_workers; ++i) SDL_WaitThread(raster->workers[i].thread, NULL);
+  SDL_DestroySemaphore(raster->start);
+  SDL_DestroySemaphore(raster->done);
+
+  SDL_ClearProperty(SDL_GetRendererProperties(raster->renderer), SOFT_RASTER_PROPERTY);
+  if (raster->screen) resources_release(resources, raster->screen, RESOURCE_TEXTURE);
+  SDL_free(raster->tile_offsets);
+  SDL_free(raster->tile_refs);
+  SDL_zerop(raster);
+}
@@ -0,0 +1,220 @@
+// Sprites, sheets and alpha trimming.
+//
+// Most of our art is padded with transparent pixels: the belt overlays are
+// full screen images with a strip of content, and the cat sheets use
+// 1000x1000 cells. At load time every cell is cut down to its opaque bounding
+// box and the trimmed cells are repacked, so the GPU/software renderer only
+// stores and fills the pixels that can actually show up. Sprite::trim keeps
+// the offset inside the original cell, so callers still position sprites in
+// untrimmed frame coordinates.
+//
+// Sprites that are drawn much smaller than their art can carry downscaled
+// copies (mips); draw_sprite() picks the one matching the on-screen size.
+
+#define MAX_SHEET_FRAMES 8
+#define MAX_SPRITE_MIPS  3
+#define SHEET_PADDING    2 // transparent gutter between repacked cells
+
+enum AlphaClass {
+  ALPHA_OPAQUE,  // every pixel has alpha 255, drawn without blending
+  ALPHA_BINARY,  // alpha is only ever 0 or 255
+  ALPHA_BLENDED,
+};
+
+typedef struct {
+  SDL_Texture *texture;
+  SDL_FRect src;
+} SpriteMip;
+
+typedef struct {
+  SDL_Texture *texture;
+  SDL_FRect src;   // opaque pixels inside texture
+  SDL_FRect trim;  // where src sits inside the untrimmed frame
+  v2 frame_dims;   // untrimmed frame size
+  enum AlphaClass alpha; // of the whole texture, mips of opaque art stay opaque
+
+  int level;       // mip level of texture/src, 0 is the original art
+  int num_mips;    // mips[i] is level + 1 + i
+  SpriteMip mips[MAX_SPRITE_MIPS];
+} Sprite;
+
+typedef struct {
+  Sprite frames[MAX_SHEET_FRAMES];
+  int cols;
+  int rows;
+  v2 frame_dims;
+  v2 image_dims;   // untrimmed size of the whole sheet
+} SpriteSheet;
+
+typedef struct {
+  u8 *pixels; // RGBA32
+  int width;
+  int height;
+  int pitch;
+} Image;
+
+typedef struct {
+  Image image;                        // trimmed cells, repacked
+  b8 owns_pixels;                     // false if nothing could be trimmed and image aliases the source
+  int num_frames;
+  SDL_Rect cells[MAX_SHEET_FRAMES];   // where each trimmed cell ended up in image
+  SDL_Rect trims[MAX_SHEET_FRAMES];   // opaque bounds relative to the untrimmed cell
+} TrimmedSheet;
+
+b8 sheet_is_loaded(SpriteSheet *sheet) {
+  return sheet->cols > 0;
+}
+
+Sprite *sheet_frame(SpriteSheet *sheet, v2 grid_coord) {
+  int index = (int)grid_coord.y * sheet->cols + (int)grid_coord.x;
+  SDL_assert(index >= 0 && index < sheet->cols * sheet->rows);
+  return &sheet->frames[index];
+}
+
+// Bounding box of all pixels with non-zero alpha inside area. Empty rect if
+// the area is fully transparent.
+SDL_Rect image_opaque_bounds(Image *image, SDL_Rect area) {
+  int min_x = area.x + area.w, max_x = area.x - 1;
+  int min_y = area.y + area.h, max_y = area.y - 1;
+
+  for (int y = area.y; y < area.y + area.h; ++y) {
+    u8 *row = image->pixels + (size_t)y * image->pitch;
+    int first = -1, last = -1;
+    for (int x = area.x; x < area.x + area.w; ++x) {
+      if (row[x*4 + 3]) {
+        first = x;
+        break;
+      }
+    }
+    if (first < 0) continue;
+
+    for (int x = area.x + area.w - 1; x >= first; --x) {
+      if (row[x*4 + 3]) {
+        last = x;
+        break;
+      }
+    }
+
+    min_x = MIN(min_x, first);
+    max_x = MAX(max_x, last);
+    min_y = MIN(min_y, y);
+    max_y = y;
+  }
+
+  if (max_x < min_x) return (SDL_Rect){ area.x, area.y, 0, 0 };
+  return (SDL_Rect){ min_x, min_y, max_x - min_x + 1, max_y - min_y + 1 };
+}
+
+// Cuts image into cols*rows cells of cell_w*cell_h, trims each one and packs
+// the results left to right into shelves about as wide as the source.
+// Cell positions and the packed size are multiples of align (a power of two),
+// so the result can be halved that many times without cells bleeding together.
+b8 trim_sheet(Image *image, int cols, int rows, int cell_w, int cell_h, int align, TrimmedSheet *out) {
+  SDL_zerop(out);
+  out->num_frames = cols * rows;
+  if (out->num_frames > MAX_SHEET_FRAMES || cols * cell_w > image->width || rows * cell_h > image->height) {
+    SDL_Log("Sheet %dx%d of %dx%d cells does not fit a %dx%d image", cols, rows, cell_w, cell_h, image->width, image->height);
+    return false;
+  }
+
+  SDL_Rect bounds[MAX_SHEET_FRAMES];
+  for (int i = 0; i < out->num_frames; ++i) {
+    SDL_Rect cell = { (i % cols) * cell_w, (i / cols) * cell_h, cell_w, cell_h };
+    bounds[i] = image_opaque_bounds(image, cell);
+    out->trims[i] = (SDL_Rect){ bounds[i].x - cell.x, bounds[i].y - cell.y, bounds[i].w, bounds[i].h };
+  }
+
+  // A lone full frame has no neighbours to bleed into, it only needs the
+  // mip alignment, which full screen art usually has already.
+  if (out->num_frames == 1 && bounds[0].w == image->width && bounds[0].h == image->height
+      && image->width % align == 0 && image->height % align == 0) {
+    out->image = *image;
+    out->cells[0] = bounds[0];
+    return true;
+  }
+
+#define ALIGN_UP(value) (((value) + align - 1) & ~(align - 1))
+  int padding = ALIGN_UP(SHEET_PADDING);
+  int max_width = image->width + (cols + 1) * padding;
+  int x = padding, y = padding, shelf_h = 0, used_w = 0;
+  for (int i = 0; i < out->num_frames; ++i) {
+    if (bounds[i].w == 0) {
+      out->cells[i] = (SDL_Rect){0};
+      continue;
+    }
+    if (x + bounds[i].w + padding > max_width && x > padding) {
+      x = padding;
+      y += ALIGN_UP(shelf_h) + padding;
+      shelf_h = 0;
+    }
+    out->cells[i] = (SDL_Rect){ x, y, bounds[i].w, bounds[i].h };
+    x += ALIGN_UP(bounds[i].w) + padding;
+    shelf_h = MAX(shelf_h, bounds[i].h);
+    used_w = MAX(used_w, x);
+  }
+
+  Image *packed = &out->image;
+  packed->width  = MAX(used_w, align);
+  packed->height = MAX(y + ALIGN_UP(shelf_h) + padding, align);
+#undef ALIGN_UP
+  packed->pitch  = packed->width * 4;
+  packed->pixels = SDL_calloc((size_t)packed->pitch, packed->height);
+  if (!packed->pixels) return false;
+  out->owns_pixels = true;
+
+  for (int i = 0; i < out->num_frames; ++i) {
+    SDL_Rect *from = &bounds[i];
+    SDL_Rect *to = &out->cells[i];
+    for (int row = 0; row < from->h; ++row) {
+      SDL_memcpy(packed->pixels + (size_t)(to->y + row) * packed->pitch + to->x * 4,
+                 image->pixels + (size_t)(from->y + row) * image->pitch + from->x * 4,
+                 (size_t)from->w * 4);
+    }
+  }
+
+  return true;
+}
+
+// Maps an untrimmed destination rect to the rect the trimmed pixels cover.
+SDL_FRect sprite_dst_rect(Sprite *sprite, SDL_FRect *dst) {
+  f32 scale_x = dst->w / sprite->frame_dims.x;
+  f32 scale_y = dst->h / sprite->frame_dims.y;
+  return (SDL_FRect){
+    .x = dst->x + sprite->trim.x * scale_x,
+    .y = dst->y + sprite->trim.y * scale_y,
+    .w = sprite->trim.w * scale_x,
+    .h = sprite->trim.h * scale_y
+  };
+}
+
+// Picks the coarsest mip that still has at least one texel per pixel of
+// trimmed_w on screen.
+SpriteMip sprite_pick_mip(Sprite *sprite, f32 trimmed_w) {
+  SpriteMip mip = { sprite->texture, sprite->src };
+  if (sprite->num_mips == 0 || trimmed_w <= 0) return mip;
+
+  f32 texels = sprite->trim.w / (f32)(1 << sprite->level);
+  for (int i = 0; i < sprite->num_mips && texels * 0.5f >= trimmed_w; ++i) {
+    mip = sprite->mips[i];
+    texels *= 0.5f;
+  }
+  return mip;
+}
+
+void draw_sprite(SDL_Renderer *renderer, Sprite *sprite, SDL_FRect *dst) {
+  if (!sprite->texture || sprite->src.w <= 0) return;
+
+  SDL_FRect trimmed = sprite_dst_rect(sprite, dst);
+  SpriteMip mip = sprite_pick_mip(sprite, trimmed.w);
+  SDL_RenderTexture(renderer, mip.texture, &mip.src, &trimmed);
+}
+
+// center is relative to the untrimmed dst rect, like SDL_RenderTextureRotated.
+void draw_sprite_rotated(SDL_Renderer *renderer, Sprite *sprite, SDL_FRect *dst, f64 angle, SDL_FPoint *center) {
+  if (!sprite->texture || sprite->src.w <= 0) return;
+
+  SDL_FRect trimmed = sprite_dst_rect(sprite, dst);
+  SDL_FPoint trimmed_center = { dst->x + center->x - trimmed.x, dst->y + center->y - trimmed.y };
+  SpriteMip mip = sprite_pick_mip(sprite, trimmed.w);
+  SDL_RenderTextureRotated(renderer, mip.texture, &mip.src, &trimmed, angle, &trimmed_center, SDL_FLIP_NONE);
+}
@@ -0,0 +1,396 @@
+// Sprite batching and draw ordering. Instead of one SDL_RenderTexture per
+// sprite, quads are collected into a vertex buffer that lives as long as the
+// batch. Every quad carries a 64 bit sort key:
+//
+//   63..56  layer       declared by the game, drawn back to front
+//   55..40  texture id  first-seen order of the texture this frame
+//   39..8   depth       float, smaller is further back
+//
+// On flush the keys are radix sorted (stable, so equal keys keep their
+// submission order) and every run of one texture goes out as a single
+// SDL_RenderGeometry call. Draw order comes from the layer alone, not from
+// the order of the draw calls in the code.
+//
+// With a DirtyTracker attached (sprite_batch_use_dirty_rects), the frame is
+// drawn into the tracker's canvas and only quads touching a dirty rect are
+// submitted, clipped to that rect.
+//
+// With a SoftRaster attached (sprite_batch_use_soft_raster), the sorted quads
+// are rasterized on the CPU instead and the framebuffer is presented at the
+// end of the frame. It keeps its pixels, so it doubles as the dirty canvas.
+//
+// With a DynamicRes attached (sprite_batch_use_dynamic_res), the frame is
+// drawn at its current scale and stretched over the window at the end.
+// Dirty rects are not used then, the whole frame changes with the scale.
+//
+// The queue grows to hold the whole frame, so the sort always sees every
+// quad. Only if it cannot grow is it flushed early, and then the layers no
+// longer order the quads before the flush against the ones after it.
+
+#define SPRITE_BATCH_MIN_QUADS    1024
+#define SPRITE_BATCH_MAX_TEXTURES 256
+
+typedef struct {
+  u64 key;
+  u32 quad;
+} BatchSortItem;
+
+typedef struct {
+  SDL_Renderer *renderer;
+  DirtyTracker *dirty; // NULL redraws everything every frame
+  SoftRaster *raster;  // NULL draws with the SDL renderer
+  DynamicRes *dynres;  // NULL draws at the window's resolution
+
+  // Arrays of max_quads quads, see sprite_batch_reserve().
+  int num_quads;
+  int max_quads;
+  SDL_Texture **quad_textures;
+  SDL_Rect *quad_bounds;
+  BatchSortItem *sort_items;
+  BatchSortItem *sort_scratch;
+  SDL_Vertex *vertices;          // 4 per quad
+  SDL_Vertex *sorted;            // queue order after sorting, or one dirty rect's share
+  SDL_Texture **sorted_textures; // texture of each quad in sorted
+  int *indices;                  // 6 per quad, the same two triangles for each
+  int num_early_flushes;         // the queue was full and could not grow
+
+  SDL_Texture *textures[SPRITE_BATCH_MAX_TEXTURES]; // index is the texture id
+  int num_textures;
+
+  // Sprites submitted vs. SDL_RenderGeometry calls made. The frame_*
+  // values are the last finished frame.
+  int num_sprites;
+  int num_draw_calls;
+  int frame_sprites;
+  int frame_draw_calls;
+} SpriteBatch;
+
+void sprite_batch_init(SpriteBatch *batch, SDL_Renderer *renderer) {
+  SDL_zerop(batch);
+  batch->renderer = renderer;
+}
+
+// Makes room for max_quads quads, keeping the queued ones. The queue grows by
+// itself when a frame needs more, reserving up front just keeps the
+// reallocation out of the frame.
+b8 sprite_batch_reserve(SpriteBatch *batch, int max_quads) {
+  if (max_quads <= batch->max_quads) return true;
+
+  b8 grown = true;
+#define SPRITE_BATCH_GROW(array, per_quad)                                                      \
+  do {                                                                                          \
+    void *larger = SDL_realloc(batch->array, sizeof(*batch->array) * (per_quad) * max_quads);   \
+    if (larger) batch->array = larger;                                                          \
+    else grown = false;                                                                         \
+  } while (0)
+  SPRITE_BATCH_GROW(quad_textures, 1);
+  SPRITE_BATCH_GROW(quad_bounds, 1);
+  SPRITE_BATCH_GROW(sort_items, 1);
+  SPRITE_BATCH_GROW(sort_scratch, 1);
+  SPRITE_BATCH_GROW(vertices, 4);
+  SPRITE_BATCH_GROW(sorted, 4);
+  SPRITE_BATCH_GROW(sorted_textures, 1);
+  SPRITE_BATCH_GROW(indices, 6);
+#undef SPRITE_BATCH_GROW
+  if (!grown) return false;
+
+  for (int i = batch->max_quads; i < max_quads; ++i) {
+    int *index = &batch->indices[i * 6];
+    int first = i * 4;
+    index[0] = first;     index[1] = first + 1; index[2] = first + 2;
+    index[3] = first;     index[4] = first + 2; index[5] = first + 3;
+  }
+  batch->max_quads = max_quads;
+  return true;
+}
+
+void sprite_batch_destroy(SpriteBatch *batch) {
+  SDL_free(batch->quad_textures);
+  SDL_free(batch->quad_bounds);
+  SDL_free(batch->sort_items);
+  SDL_free(batch->sort_scratch);
+  SDL_free(batch->vertices);
+  SDL_free(batch->sorted);
+  SDL_free(batch->sorted_textures);
+  SDL_free(batch->indices);
+  SDL_zerop(batch);
+}
+
+// Ids only live for one frame. Once the table is full, the remaining
+// textures share the last id, which costs merging but not correctness.
+static u64 sprite_batch_texture_id(SpriteBatch *batch, SDL_Texture *texture) {
+  for (int i = 0; i < batch->num_textures; ++i)
+    if (batch->textures[i] == texture) return (u64)i;
+
+  if (batch->num_textures == SPRITE_BATCH_MAX_TEXTURES) return SPRITE_BATCH_MAX_TEXTURES - 1;
+  batch->textures[batch->num_textures] = texture;
+  return (u64)batch->num_textures++;
+}
+
+// Flips float bits so that unsigned order matches float order.
+static u32 sortable_depth(f32 depth) {
+  u32 bits;
+  SDL_memcpy(&bits, &depth, sizeof(bits));
+  return (bits & 0x80000000u) ? ~bits : bits | 0x80000000u;
+}
+
+static u64 sprite_batch_key(SpriteBatch *batch, u8 layer, SDL_Texture *texture, f32 depth) {
+  return (u64)layer << 56 | sprite_batch_texture_id(batch, texture) << 40 | (u64)sortable_depth(depth) << 8;
+}
+
+// LSD radix sort over 8 bit digits. Digits that are the same for every key
+// (the unused low byte, usually most of the depth) are skipped.
+static void sprite_batch_sort(SpriteBatch *batch) {
+  int count = batch->num_quads;
+  BatchSortItem *items = batch->sort_items;
+  BatchSortItem *scratch = batch->sort_scratch;
+
+  for (int shift = 0; shift < 64; shift += 8) {
+    int offsets[256] = {0};
+    for (int i = 0; i < count; ++i) offsets[(items[i].key >> shift) & 0xff]++;
+    if (offsets[(items[0].key >> shift) & 0xff] == count) continue;
+
+    int total = 0;
+    for (int digit = 0; digit < 256; ++digit) {
+      int digit_count = offsets[digit];
+      offsets[digit] = total;
+      total += digit_count;
+    }
+    for (int i = 0; i < count; ++i) scratch[offsets[(items[i].key >> shift) & 0xff]++] = items[i];
+
+    BatchSortItem *swap = items;
+    items = scratch;
+    scratch = swap;
+  }
+
+  if (items != batch->sort_items)
+    SDL_memcpy(batch->sort_items, items, sizeof(BatchSortItem) * count);
+}
+
+void sprite_batch_use_soft_raster(SpriteBatch *batch, SoftRaster *raster) {
+  batch->raster = raster;
+}
+
+void sprite_batch_use_dynamic_res(SpriteBatch *batch, DynamicRes *dynres) {
+  batch->dynres = dynres;
+}
+
+void sprite_batch_use_dirty_rects(SpriteBatch *batch, DirtyTracker *dirty) {
+  batch->dirty = dirty;
+  if (dirty) dirty_invalidate(dirty);
+}
+
+// For changes the dirty rect tracker cannot see, e.g. new contents in a
+// texture that is drawn with the same quad as last frame.
+void sprite_batch_invalidate(SpriteBatch *batch) {
+  if (batch->dirty) dirty_invalidate(batch->dirty);
+}
+
+// Call before the first draw of a frame.
+void sprite_batch_begin_frame(SpriteBatch *batch) {
+  if (batch->dynres) dynamic_res_begin_frame(batch->dynres);
+  else if (batch->dirty && !batch->raster) SDL_SetRenderTarget(batch->renderer, batch->dirty->canvas);
+}
+
+// Submits the sorted quads in vertices, count quads long, one call per
+// texture run.
+static void sprite_batch_submit(SpriteBatch *batch, SDL_Vertex *vertices, SDL_Texture **textures, int count) {
+  int run_start = 0;
+  for (int i = 1; i <= count; ++i) {
+    if (i < count && textures[i] == textures[run_start]) continue;
+
+    int run_count = i - run_start;
+    if (batch->raster) {
+      for (int quad = run_start; quad < i; ++quad) soft_raster_quad(batch->raster, textures[quad], &vertices[quad * 4]);
+    } else {
+      SDL_RenderGeometry(batch->renderer, textures[run_start],
+                         &vertices[run_start * 4], run_count * 4, batch->indices, run_count * 6);
+    }
+    batch->num_draw_calls++;
+    run_start = i;
+  }
+}
+
+// Sorts the queue and gathers the quads, optionally only those touching clip.
+static int sprite_batch_gather(SpriteBatch *batch, SDL_Rect *clip, SDL_Vertex *out, SDL_Texture **textures) {
+  int count = 0;
+  for (int i = 0; i < batch->num_quads; ++i) {
+    u32 quad = batch->sort_items[i].quad;
+    if (clip && !SDL_HasRectIntersection(clip, &batch->quad_bounds[quad])) continue;
+
+    SDL_memcpy(&out[count * 4], &batch->vertices[quad * 4], sizeof(SDL_Vertex) * 4);
+    textures[count++] = batch->quad_textures[quad];
+  }
+  return count;
+}
+
+// Submits everything queued so far. Call it before drawing anything
+// directly with the renderer, so the order on screen stays right. Such
+// draws are invisible to the dirty rect tracker, so this frame and the
+// next one are redrawn in full. With a SoftRaster they end up underneath the
+// framebuffer, use sprite_batch_fill() for placeholders instead.
+void sprite_batch_flush(SpriteBatch *batch) {
+  if (batch->dirty) dirty_invalidate(batch->dirty);
+  if (batch->num_quads == 0) return;
+
+  PROFILE_BEGIN("batch flush");
+  sprite_batch_sort(batch);
+  int count = sprite_batch_gather(batch, NULL, batch->sorted, batch->sorted_textures);
+  sprite_batch_submit(batch, batch->sorted, batch->sorted_textures, count);
+  batch->num_quads = 0;
+  if (batch->raster) soft_raster_flush(batch->raster);
+  PROFILE_END();
+}
+
+static void sprite_batch_flush_dirty(SpriteBatch *batch) {
+  DirtyTracker *dirty = batch->dirty;
+  dirty_compute(dirty);
+
+  sprite_batch_sort(batch);
+  for (int r = 0; r < dirty->num_rects; ++r) {
+    SDL_Rect *rect = &dirty->rects[r];
+    int count = sprite_batch_gather(batch, rect, batch->sorted, batch->sorted_textures);
+    if (batch->raster) soft_raster_set_clip(batch->raster, rect);
+    else SDL_SetRenderClipRect(batch->renderer, rect);
+    sprite_batch_submit(batch, batch->sorted, batch->sorted_textures, count);
+  }
+  batch->num_quads = 0;
+
+  if (batch->raster) {
+    soft_raster_set_clip(batch->raster, NULL);
+    soft_raster_present(batch->raster, dirty->rects, dirty->num_rects);
+    return;
+  }
+  SDL_SetRenderClipRect(batch->renderer, NULL);
+  SDL_SetRenderTarget(batch->renderer, NULL);
+  SDL_RenderTexture(batch->renderer, dirty->canvas, NULL, NULL);
+}
+
+// A quad that is already in screen space, corners in clockwise order
+// starting top left, like SDL_RenderGeometry with two triangles 0-1-2, 0-2-3.
+void sprite_batch_vertices(SpriteBatch *batch, u8 layer, f32 depth, SDL_Texture *texture, const SDL_Vertex *vertices) {
+  if (batch->num_quads == batch->max_quads
+      && !sprite_batch_reserve(batch, SDL_max(batch->max_quads * 2, SPRITE_BATCH_MIN_QUADS))) {
+    if (batch->num_early_flushes++ == 0)
+      SDL_Log("Sprite batch could not grow past %d quads, flushing early: later layers can end up underneath", batch->max_quads);
+    sprite_batch_flush(batch);
+    if (batch->max_quads == 0) return;
+  }
+
+  int index = batch->num_quads++;
+  batch->quad_textures[index] = texture;
+  batch->sort_items[index] = (BatchSortItem){ sprite_batch_key(batch, layer, texture, depth), (u32)index };
+  batch->num_sprites++;
+
+  SDL_Vertex *vertex = &batch->vertices[index * 4];
+  SDL_memcpy(vertex, vertices, sizeof(SDL_Vertex) * 4);
+
+  if (batch->dirty) {
+    f32 min_x = vertex[0].position.x, max_x = vertex[0].position.x, min_y = vertex[0].position.y, max_y = vertex[0].position.y;
+    for (int i = 1; i < 4; ++i) {
+      min_x = SDL_min(min_x, vertex[i].position.x);
+      max_x = SDL_max(max_x, vertex[i].position.x);
+      min_y = SDL_min(min_y, vertex[i].position.y);
+      max_y = SDL_max(max_y, vertex[i].position.y);
+    }
+    // One pixel of margin for filtering at the edges.
+    SDL_Rect *bounds = &batch->quad_bounds[index];
+    bounds->x = (int)SDL_floorf(min_x) - 1;
+    bounds->y = (int)SDL_floorf(min_y) - 1;
+    bounds->w = (int)SDL_ceilf(max_x) + 1 - bounds->x;
+    bounds->h = (int)SDL_ceilf(max_y) + 1 - bounds->y;
+
+    // The texture id depends on what else was drawn first, leave it out.
+    u64 key = batch->sort_items[index].key & ~((u64)0xffff << 40);
+    u64 hash = dirty_hash(&texture, sizeof(texture), 0xcbf29ce484222325ull);
+    hash = dirty_hash(&key, sizeof(key), hash);
+    hash = dirty_hash(vertex, sizeof(SDL_Vertex) * 4, hash);
+    dirty_record(batch->dirty, hash, *bounds);
+  }
+}
+
+// src is in texels, dst in screen pixels. angle is in degrees, clockwise
+// around center (relative to dst), like SDL_RenderTextureRotated. Without a
+// texture the quad is filled with color, see sprite_batch_fill().
+void sprite_batch_quad(SpriteBatch *batch, u8 layer, f32 depth, SDL_Texture *texture, SDL_FRect *src, SDL_FRect *dst,
+                       f64 angle, SDL_FPoint *center, SDL_FColor color) {
+  f32 u0 = 0, u1 = 0, v0 = 0, v1 = 0;
+  if (texture) {
+    u0 = src->x / texture->w, u1 = (src->x + src->w) / texture->w;
+    v0 = src->y / texture->h, v1 = (src->y + src->h) / texture->h;
+  }
+  SDL_FPoint corners[4] = {
+    { dst->x,          dst->y          },
+    { dst->x + dst->w, dst->y          },
+    { dst->x + dst->w, dst->y + dst->h },
+    { dst->x,          dst->y + dst->h },
+  };
+  SDL_FPoint uvs[4] = { {u0, v0}, {u1, v0}, {u1, v1}, {u0, v1} };
+
+  if (angle != 0.0) {
+    f32 radians = (f32)(angle * SDL_PI_D / 180.0);
+    f32 s = SDL_sinf(radians), c = SDL_cosf(radians);
+    f32 cx = dst->x + (center ? center->x : dst->w * 0.5f);
+    f32 cy = dst->y + (center ? center->y : dst->h * 0.5f);
+    for (int i = 0; i < 4; ++i) {
+      f32 x = corners[i].x - cx, y = corners[i].y - cy;
+      corners[i] = (SDL_FPoint){ cx + x*c - y*s, cy + x*s + y*c };
+    }
+  }
+
+  SDL_Vertex vertices[4];
+  for (int i = 0; i < 4; ++i)
+    vertices[i] = (SDL_Vertex){ .position = corners[i], .color = color, .tex_coord = uvs[i] };
+  sprite_batch_vertices(batch, layer, depth, texture, vertices);
+}
+
+// Solid rect for placeholders. Drawn with the renderer's draw blend mode
+// (none by default), so keep color opaque.
+void sprite_batch_fill(SpriteBatch *batch, u8 layer, SDL_FRect *rect, SDL_Color color) {
+  SDL_FColor fcolor = { color.r / 255.f, color.g / 255.f, color.b / 255.f, color.a / 255.f };
+  sprite_batch_quad(batch, layer, 0, NULL, NULL, rect, 0.0, NULL, fcolor);
+}
+
+void sprite_batch_draw(SpriteBatch *batch, u8 layer, f32 depth, Sprite *sprite, SDL_FRect *dst) {
+  if (!sprite->texture || sprite->src.w <= 0) return;
+
+  SDL_FRect trimmed = sprite_dst_rect(sprite, dst);
+  SpriteMip mip = sprite_pick_mip(sprite, trimmed.w);
+  sprite_batch_quad(batch, layer, depth, mip.texture, &mip.src, &trimmed, 0.0, NULL, (SDL_FColor){1, 1, 1, 1});
+}
+
+// center is relative to the untrimmed dst rect, like draw_sprite_rotated().
+void sprite_batch_draw_rotated(SpriteBatch *batch, u8 layer, f32 depth, Sprite *sprite, SDL_FRect *dst, f64 angle, SDL_FPoint *center) {
+  if (!sprite->texture || sprite->src.w <= 0) return;
+
+  SDL_FRect trimmed = sprite_dst_rect(sprite, dst);
+  SDL_FPoint trimmed_center = { dst->x + center->x - trimmed.x, dst->y + center->y - trimmed.y };
+  SpriteMip mip = sprite_pick_mip(sprite, trimmed.w);
+  sprite_batch_quad(batch, layer, depth, mip.texture, &mip.src, &trimmed, angle, &trimmed_center, (SDL_FColor){1, 1, 1, 1});
+}
+
+// Flushes and closes the frame's stats, call it right before SDL_RenderPresent.
+void sprite_batch_end_frame(SpriteBatch *batch) {
+  if (batch->dirty && !batch->dynres) {
+    sprite_batch_flush_dirty(batch);
+  } else {
+    sprite_batch_flush(batch);
+    if (batch->raster) soft_raster_present(batch->raster, NULL, 0);
+    else if (batch->dynres) dynamic_res_end_frame(batch->dynres);
+  }
+  batch->frame_sprites = batch->num_sprites;
+  batch->frame_draw_calls = batch->num_draw_calls;
+  batch->num_sprites = 0;
+  batch->num_draw_calls = 0;
+  batch->num_textures = 0;
+}
+
+void sprite_batch_report(SpriteBatch *batch) {
+  SDL_Log("sprite batch: %d sprites (one draw call each before batching) -> %d draw calls",
+          batch->frame_sprites, batch->frame_draw_calls);
+  if (batch->num_early_flushes)
+    SDL_Log("sprite batch: flushed early %d times, out of memory at %d quads", batch->num_early_flushes, batch->max_quads);
+  if (batch->dirty) dirty_report(batch->dirty);
+  if (batch->raster) soft_raster_report(batch->raster);
+  if (batch->dynres) dynamic_res_report(batch->dynres);
+}
@@ -0,0 +1,54 @@
+// Hands whole frames from one producer thread to one consumer without locks
+// or waiting. There are three slots: the producer's, the consumer's and the
+// one in between. Publishing swaps the producer's slot with the one in between
+// and marks it fresh, acquiring swaps the consumer's with it if it is fresh.
+// Both are one atomic exchange on ready, so each side always has a slot of
+// its own, the consumer always gets the newest frame, and a frame the
+// consumer never picked up is overwritten rather than queued.
+
+#define TRIPLE_BUFFER_FRESH 4 // in ready, next to the slot index
+
+typedef struct {
+  void *slots[3];
+  int write;           // producer only
+  int read;            // consumer only, -1 until the first acquire
+  SDL_AtomicInt ready; // index of the slot in between | TRIPLE_BUFFER_FRESH
+  SDL_AtomicInt num_published;
+  SDL_AtomicInt num_overwritten; // published but never acquired
+} TripleBuffer;
+
+void triple_buffer_init(TripleBuffer *buffer, void *slot0, void *slot1, void *slot2) {
+  SDL_zerop(buffer);
+  buffer->slots[0] = slot0;
+  buffer->slots[1] = slot1;
+  buffer->slots[2] = slot2;
+  buffer->write = 0;
+  buffer->read = -1;
+  SDL_SetAtomicInt(&buffer->ready, 1);
+}
+
+// Producer: where the next frame goes. Stays the same until published.
+void *triple_buffer_write_slot(TripleBuffer *buffer) {
+  return buffer->slots[buffer->write];
+}
+
+// Producer: hands the written slot over and gets another one to write to.
+void triple_buffer_publish(TripleBuffer *buffer) {
+  int previous = SDL_SetAtomicInt(&buffer->ready, buffer->write | TRIPLE_BUFFER_FRESH);
+  if (previous & TRIPLE_BUFFER_FRESH) SDL_AddAtomicInt(&buffer->num_overwritten, 1);
+  SDL_AddAtomicInt(&buffer->num_published, 1);
+  buffer->write = previous & 3;
+}
+
+// Consumer: the newest published frame, or the one it got last time if
+// nothing new came. NULL before the first publish. The slot stays the
+// consumer's until the next call.
+void *triple_buffer_acquire(TripleBuffer *buffer) {
+  if (!(SDL_GetAtomicInt(&buffer->ready) & TRIPLE_BUFFER_FRESH))
+    return buffer->read >= 0 ? buffer->slots[buffer->read] : NULL;
+
+  //NOTE: Before the first acquire the consumer holds slot 2, nobody wrote it.
+  int mine = buffer->read >= 0 ? buffer->read : 2;
+  buffer->read = SDL_SetAtomicInt(&buffer->ready, mine) & 3;
+  return buffer->slots[buffer->read];
+}